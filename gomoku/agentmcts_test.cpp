@@ -14,3 +14,29 @@ TEST_CASE("Gomoku::AgentMCTS::Node::to_s/from_s", "[gomoku][agentmcts]") {
 	REQUIRE(k.from_s(s));
 	REQUIRE(n.to_s() == k.to_s());
 }
+
+TEST_CASE("Gomoku::AgentMCTS lazy expansion", "[gomoku][agentmcts]") {
+	Board b("9");
+	AgentMCTS full(b), lazy(b);
+	lazy.widen = 4;
+	lazy.numthreads = 2;
+	lazy.pool.set_num_threads(lazy.numthreads);
+
+	full.search(0, 100, 0);
+	lazy.search(0, 100, 0);
+
+	REQUIRE(full.root.children.num() == (unsigned int)b.moves_avail());
+	REQUIRE(lazy.root.children.num() >= 4);
+	REQUIRE(lazy.root.children.num() < (unsigned int)b.moves_avail());
+	REQUIRE(lazy.nodes < full.nodes);
+
+	REQUIRE(lazy.nodes > lazy.root.size()); //counts the children replaced by wider sets
+	lazy.free_retired();
+	REQUIRE(lazy.nodes == lazy.root.size());
+
+	lazy.widen = 0; //nodes already expanded lazily are still missing moves
+	REQUIRE(lazy.root.partial(b));
+	REQUIRE_FALSE(full.root.partial(b));
+	lazy.search(0, 100, 0);
+	REQUIRE(lazy.root.outcome == Outcome::UNKNOWN);
+}
@@ -1,4 +1,6 @@
 
+#include "../lib/thread.h"
+
 #include "board.h"
 
 namespace Morat {
@@ -80,9 +82,15 @@ std::string Board::to_s(bool color, std::function<std::string(Move)> func) const
 	return s;
 }
 
-std::shared_ptr<MoveValid> Board::gen_neighbor_list() const {
-	std::shared_ptr<MoveValid> list(new MoveValid[vec_size()*24]);
-	MoveValid * a = list.get();
+//one list per board size, built the first time a board of that size is made and shared by all of them after that,
+//so copying a board never has to allocate or reference count
+const MoveValid * Board::gen_neighbor_list() const {
+	static MoveValid * lists[max_size + 1] = {};
+	if(lists[size_])
+		return lists[size_];
+
+	MoveValid * list = new MoveValid[vec_size()*24];
+	MoveValid * a = list;
 	for(int y = 0; y < size_; y++){
 		for(int x = 0; x < size_; x++){
 			Move pos(x,y);
@@ -95,6 +103,11 @@ std::shared_ptr<MoveValid> Board::gen_neighbor_list() const {
 		}
 	}
 
+	//another thread may have built it at the same time, only keep one of them
+	if(!CAS(lists[size_], (MoveValid *)NULL, list)){
+		delete[] list;
+		list = lists[size_];
+	}
 	return list;
 }
 
@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <cassert>
 #include <cstdio>
+#include <cstring>
 #include <functional>
 #include <memory>
 #include <ostream>
@@ -12,6 +13,7 @@
 
 #include "../lib/bitcount.h"
 #include "../lib/board_grid_oct.h"
+#include "../lib/board_journal.h"
 #include "../lib/board_shape_square.h"
 #include "../lib/hashset.h"
 #include "../lib/move.h"
@@ -58,23 +60,46 @@ private:
 	Side to_play_;
 	Outcome outcome_;
 
-	std::vector<Cell> cells_;
 	Zobrist<1> hash;
-	std::shared_ptr<MoveValid> neighbor_list_;
+	const MoveValid * neighbor_list_; //shared by all boards of this size
+	BoardJournal<Cell> * journal_;    //saves what each move changes so it can be undone, see set_journal
+
+	//the pieces of each side as one bit per cell along every row, column and diagonal, so finding five in a row is a
+	//few shifts and ands instead of walking the neighbors. Indexed by side-1, then by the line, bit i is x=i except
+	//in the columns where it's y=i. Diagonals are numbered x-y+size-1, antidiagonals x+y. Undo clears the bit of the
+	//last move, so these aren't saved by the journal
+	uint32_t rows_[2][max_size];
+	uint32_t cols_[2][max_size];
+	uint32_t diags_[2][2*max_size-1];
+	uint32_t antidiags_[2][2*max_size-1];
+
+	//fixed size so copies are a flat memcpy without allocating, only the first vec_size() are used. It must stay the
+	//last member since copies stop at the end of the cells in use. It's in a union so the unused ones aren't
+	//constructed for each copy either
+	union {
+		Cell cells_[max_vec_size];
+	};
 
 public:
 	Board() = delete;
-	explicit Board(std::string s) {
+	explicit Board(std::string s) : journal_(NULL) {
 		assert(size(s));
 	}
 
+	Board(const Board & o) { *this = o; }
+	Board & operator = (const Board & o) {
+		//all the members are plain data, so copy everything up to the end of the cells in use
+		memcpy((void *)this, (const void *)&o, (const char *)(o.cells_ + o.vec_size()) - (const char *)&o);
+		journal_ = NULL; //a copy starts without one
+		return *this;
+	}
+
 	bool size(std::string s) {
 		if (!valid_size(s))
 			return false;
 		size_ = from_str<int>(s);
 		neighbor_list_ = gen_neighbor_list();
 		num_cells_ = vec_size();
-		cells_.resize(vec_size());
 		clear();
 		return true;
 	}
@@ -86,6 +111,11 @@ public:
 		outcome_ = Outcome::UNKNOWN;
 		hash.clear();
 
+		memset(rows_, 0, sizeof(rows_));
+		memset(cols_, 0, sizeof(cols_));
+		memset(diags_, 0, sizeof(diags_));
+		memset(antidiags_, 0, sizeof(antidiags_));
+
 		for(int y = 0; y < size_; y++){
 			for(int x = 0; x < size_; x++){
 				MoveValid pos = move_valid(x, y);
@@ -104,7 +134,7 @@ public:
 		return (min_size <= size && size <= max_size);
 	}
 
-	int mem_size() const { return sizeof(Board) + sizeof(Cell)*vec_size(); }
+	int mem_size() const { return sizeof(Board); }
 	int vec_size() const { return size_*size_; }
 	int num_cells() const { return num_cells_; }
 
@@ -180,6 +210,19 @@ public:
 		return hash.test(0, 3 * pos.xy + turn);
 	}
 
+	//while a journal is set, moves can be taken back with undo in the reverse order they were made, which is much
+	//cheaper than copying the board for each move when searching deep in a tree
+	void set_journal(BoardJournal<Cell> * journal) { journal_ = journal; }
+
+	//take back the last move, only valid for moves that succeeded while the journal was set
+	void undo() {
+		assert(journal_ && journal_->depth() > 0);
+		MoveValid pos = move_valid(last_move_);
+		toggle_lines(pos, get(pos));
+		clear_pattern(pos);
+		journal_->undo(this, cells_);
+	}
+
 	bool move(const Move & pos, bool checkwin = true, bool permanent = true) {
 		return move(MoveValid(pos, xy(pos)), checkwin, permanent);
 	}
@@ -189,6 +232,9 @@ public:
 		if(!valid_move(pos))
 			return false;
 
+		if(journal_)
+			journal_->begin(this, (const char *)rows_ - (const char *)this);
+
 		if(checkwin) {
 			outcome_ = test_outcome(pos, to_play_);
 		}
@@ -196,12 +242,14 @@ public:
 		last_move_ = pos;
 		num_moves_++;
 
+		save(pos.xy);
 		Cell& cell = cells_[pos.xy];
 		cell.piece = to_play_;
 		cell.perm = permanent;
 
 		update_hash(pos, to_play_); //depends on num_moves_
 		update_pattern(pos, to_play_);
+		toggle_lines(pos, to_play_);
 
 		to_play_ = ~to_play_;
 
@@ -213,29 +261,10 @@ public:
 	Outcome test_outcome(const Move & pos, Side turn) const { return test_outcome(MoveValid(pos, xy(pos)), turn); }
 	Outcome test_outcome(const MoveValid & pos) const { return test_outcome(pos, to_play()); }
 	Outcome test_outcome(const MoveValid & pos, Side turn) const {
-		if (test_local(pos, turn)) {
-			for (int d = 0; d < 4; d++) {
-				int num = 1;
-				MoveValid nb = pos;
-				for (int i = 0; i < 4; i++) {
-					nb = neighbors(nb)[d];
-					if (nb.on_board() && get(nb) == turn)
-						num++;
-					else
-						break;
-				}
-				nb = pos;
-				for (int i = 0; i < 4; i++) {
-					nb = neighbors(nb)[d + 4];
-					if (nb.on_board() && get(nb) == turn)
-						num++;
-					else
-						break;
-				}
-				if (num >= 5)
-					return +turn;
-			}
-		}
+		int s = turn.to_i() - 1, x = pos.x, y = pos.y;
+		if (five(rows_[s][y], x) || five(cols_[s][x], y) ||
+		    five(diags_[s][x - y + size_ - 1], x) || five(antidiags_[s][x + y], x))
+			return +turn;
 
 		if(num_moves_+1 == num_cells_)
 			return Outcome::DRAW;
@@ -244,7 +273,29 @@ public:
 	}
 
 private:
-	std::shared_ptr<MoveValid> gen_neighbor_list() const;
+	const MoveValid * gen_neighbor_list() const;
+
+	//would adding bit i to this line make five or more in a row through it
+	static bool five(uint32_t line, int i) {
+		uint64_t l = line | (1u << i);
+		uint64_t runs = l & (l >> 1) & (l >> 2) & (l >> 3) & (l >> 4); //bit j set for a run of five starting at j
+		return runs & ((0x1Full << i) >> 4);
+	}
+
+	//add or remove a piece from the lines through it
+	void toggle_lines(const MoveValid & pos, Side side) {
+		int s = side.to_i() - 1, x = pos.x, y = pos.y;
+		rows_[s][y] ^= 1u << x;
+		cols_[s][x] ^= 1u << y;
+		diags_[s][x - y + size_ - 1] ^= 1u << x;
+		antidiags_[s][x + y] ^= 1u << x;
+	}
+
+	//save a cell before changing it, so the move can be undone
+	void save(int i) const {
+		if(journal_)
+			journal_->save(i, cells_[i]);
+	}
 
 	friend class BoardGridOct;
 	friend class BoardShapeSquare;
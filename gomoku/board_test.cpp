@@ -1,6 +1,7 @@
 
 #include "../lib/catch.hpp"
 #include "../lib/string.h"
+#include "../lib/xorshift.h"
 
 #include "board.h"
 
@@ -141,3 +142,81 @@ TEST_CASE("Gomoku::Board", "[gomoku][board]") {
 		test_game(b, "g7 a1 g1 a5 g2 a2 g3 a4 g5 a3", Outcome::P2);
 	}
 }
+
+//play random moves, taking some back along the way, and check that each undo gives back exactly the board from
+//before the move
+void test_undo(Board b) {
+	BoardJournal<Board::Cell> journal;
+	b.set_journal(&journal);
+
+	XORShift_uint32 rand(42);
+	std::vector<Board> before;
+	for(int i = 0; i < 1000; i++) {
+		if(!before.empty() && (b.outcome() != Outcome::UNKNOWN || rand() % 3 == 0)) {
+			b.undo();
+			const Board & o = before.back();
+			CAPTURE(o);
+			REQUIRE(b.to_s(false) == o.to_s(false));
+			REQUIRE(b.gethash() == o.gethash());
+			REQUIRE(b.to_play() == o.to_play());
+			REQUIRE(b.moves_made() == o.moves_made());
+			REQUIRE(b.outcome() == o.outcome());
+			for(auto m : o) // the groups are back as they were too
+				REQUIRE(b.test_outcome(m) == o.test_outcome(m));
+			before.pop_back();
+		} else {
+			std::vector<Move> moves;
+			for(auto m : b)
+				moves.push_back(m);
+			before.push_back(b);
+			REQUIRE(b.move(moves[rand() % moves.size()]));
+		}
+	}
+	REQUIRE(journal.depth() == before.size());
+}
+
+TEST_CASE("Gomoku::Board undo", "[gomoku][board]") {
+	test_undo(Board("9"));
+}
+
+//the length of the line of turn's pieces that playing at x,y would make, counted a cell at a time
+int line_length(const Board & b, int size, int x, int y, Side turn) {
+	int longest = 0;
+	int dirs[4][2] = {{1,0}, {0,1}, {1,1}, {1,-1}};
+	for(auto d : dirs) {
+		int num = 1;
+		for(int s : {1, -1}) {
+			for(int i = 1; ; i++) {
+				int nx = x + s*i*d[0], ny = y + s*i*d[1];
+				if(nx < 0 || ny < 0 || nx >= size || ny >= size || b.get(nx, ny) != turn)
+					break;
+				num++;
+			}
+		}
+		longest = std::max(longest, num);
+	}
+	return longest;
+}
+
+//check the line bitboards against counting the cells on random boards of all sizes, with moves that don't end the
+//game so boards can fill up with long lines of both sides
+TEST_CASE("Gomoku::Board lines", "[gomoku][board]") {
+	XORShift_uint32 rand(7);
+	for(int size : {5, 13, 25}) {
+		for(int game = 0; game < 3; game++) {
+			Board b(to_str(size));
+			for(int i = 0; i < size*size - 1; i++) {
+				std::vector<Move> moves;
+				for(auto m : b)
+					moves.push_back(m);
+				int wrong = 0;
+				for(auto m : moves)
+					for(Side turn : {Side::P1, Side::P2})
+						wrong += ((b.test_outcome(m, turn) == +turn) != (line_length(b, size, m.x, m.y, turn) >= 5));
+				CAPTURE(b);
+				REQUIRE(wrong == 0);
+				REQUIRE(b.move(moves[rand() % moves.size()], false));
+			}
+		}
+	}
+}
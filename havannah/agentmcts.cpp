@@ -54,6 +54,7 @@ void AgentMCTS::search(double time, uint64_t max_runs, int verbose){
 	Time starttime;
 
 	pool.pause();
+	free_retired();
 
 	if(runs)
 		logerr("Pondered " + to_str(runs) + " runs\n");
@@ -65,7 +66,8 @@ void AgentMCTS::search(double time, uint64_t max_runs, int verbose){
 	//let them run!
 	pool.resume();
 
-	pool.wait_pause(time);
+	pool.wait_pause(timeman.begin(time, clock, flexible));
+	timeman.end();
 
 	double time_used = Time() - starttime;
 
@@ -126,6 +128,8 @@ void AgentMCTS::search(double time, uint64_t max_runs, int verbose){
 
 		if(root.outcome != Outcome::UNKNOWN)
 			logerr("Solved as a " + root.outcome.to_s_rel(to_play) + "\n");
+		if(timeman.enabled() && time > 0 && root.outcome == Outcome::UNKNOWN && (time_used < time*0.95 || time_used > time*1.05))
+			logerr(std::string(time_used < time ? "Stopped early" : "Extended") + " after " + to_str(time_used, 3) + " of " + to_str(time, 3) + " sec\n");
 
 		std::string pvstr;
 		for(const auto& m : Agent::get_pv())
@@ -147,6 +151,8 @@ void AgentMCTS::search(double time, uint64_t max_runs, int verbose){
 AgentMCTS::AgentMCTS(const Board & b) : Agent(b), pool(this) {
 	nodes = 0;
 	runs = 0;
+	clock = 0;
+	flexible = true;
 	gclimit = 5;
 
 	profile     = false;
@@ -155,6 +161,7 @@ AgentMCTS::AgentMCTS(const Board & b) : Agent(b), pool(this) {
 	numthreads  = 1;
 	pool.set_num_threads(numthreads);
 	maxmem      = 1000*1024*1024;
+	gcchunks    = 0;
 
 	msrave      = -2;
 	msexplore   = 0;
@@ -176,7 +183,9 @@ AgentMCTS::AgentMCTS(const Board & b) : Agent(b), pool(this) {
 	minimax     = 2;
 	detectdraw  = false;
 	visitexpand = 1;
+	widen       = 0;
 	gcsolved    = 100000;
+	ttmin       = 5;
 	longestloss = false;
 
 	localreply  = 0;
@@ -200,10 +209,46 @@ AgentMCTS::~AgentMCTS(){
 	pool.pause();
 	pool.set_num_threads(0);
 
+	free_retired();
+	free_garbage();
 	root.dealloc(ctmem);
 	ctmem.compact();
 }
 
+bool AgentMCTS::check_time(){
+	//called by one thread at a time while the rest keep searching, so the counts are a little stale, which is fine
+	uint64_t first = 0, second = 0, total = 0;
+	int best = -1, i = 0;
+	Node * end, * child = root.children.range(end);
+	for(; child != end; child++, i++){
+		uint64_t n = child->exp.num();
+		total += n;
+		if(n > first){
+			second = first;
+			first = n;
+			best = i;
+		}else if(n > second){
+			second = n;
+		}
+	}
+	return timeman.check(first, second, best, total);
+}
+
+std::string AgentMCTS::mem_stats(){
+	pool.pause();
+	std::string stats = ctmem.mem_stats().to_s();
+	if(ponder)
+		pool.resume();
+	return stats;
+}
+
+void AgentMCTS::set_ttsize(uint64_t bytes){
+	pool.pause();
+	tt.resize(bytes);
+	if(ponder)
+		pool.resume();
+}
+
 void AgentMCTS::set_ponder(bool p){
 	if(ponder != p){
 		ponder = p;
@@ -216,11 +261,18 @@ void AgentMCTS::set_ponder(bool p){
 
 void AgentMCTS::set_board(const Board & board, bool clear){
 	pool.pause();
+	free_retired();
+	free_garbage();
 
 	nodes -= root.dealloc(ctmem);
 	root = Node();
 	root.exp.addwins(visitexpand+1);
 
+	if(clear){ //the tree is empty, so give the memory back to the OS
+		ctmem.compact();
+		tt.clear();
+	}
+
 	rootboard = board;
 
 	if(ponder)
@@ -228,8 +280,7 @@ void AgentMCTS::set_board(const Board & board, bool clear){
 }
 void AgentMCTS::move(const Move & m){
 	pool.pause();
-
-	uword nodesbefore = nodes;
+	free_retired();
 
 	if(keeptree && root.children.num() > 0){
 		Node child;
@@ -242,18 +293,15 @@ void AgentMCTS::move(const Move & m){
 			}
 		}
 
-		nodes -= root.dealloc(ctmem);
+		//the threads free the rest of the tree as they search, so this doesn't have to wait for it
+		garbage.add(root);
 		root = child;
 		root.swap_tree(child);
-
-		if(nodesbefore > 0)
-			logerr("Nodes before: " + to_str(nodesbefore) + ", after: " + to_str(nodes) + ", saved " +  to_str(100.0*nodes/nodesbefore, 1) + "% of the tree\n");
 	}else{
-		nodes -= root.dealloc(ctmem);
+		garbage.add(root);
 		root = Node();
 		root.move = m;
 	}
-	assert(nodes == root.size());
 
 	rootboard.move(m);
 
@@ -425,5 +473,46 @@ void AgentMCTS::load_sgf(SGFParser<Move> & sgf, const Board & board, Node & node
 	}
 }
 
+bool AgentMCTS::save_tree(const std::string & filename, const std::string & info) {
+	pool.pause();
+	free_retired();
+
+	Time start;
+	bool ok = ctmem.save(filename, root, "agent: mcts\n" + info);
+	if(ok)
+		logerr("Saved the tree in " + to_str((Time() - start)*1000, 0) + " msec\n");
+
+	if(ponder)
+		pool.resume();
+	return ok;
+}
+
+bool AgentMCTS::load_tree(const std::string & filename) {
+	std::string info;
+	if(!CompactTreeHeader::read_info(filename, info) || parse_dict(info, "\n", ": ")["agent"] != "mcts")
+		return false;
+
+	pool.pause();
+	free_retired();
+	free_garbage();
+	nodes -= root.dealloc(ctmem);
+	ctmem.compact(); //the loaded tree goes in front of the empty chunks
+
+	Time start;
+	uint64_t loaded = 0;
+	bool ok = ctmem.load(filename, root, loaded);
+	if(ok){
+		nodes = loaded;
+		logerr("Loaded " + to_str(loaded) + " nodes in " + to_str((Time() - start)*1000, 0) + " msec\n");
+	}else{
+		root = Node();
+		root.exp.addwins(visitexpand+1);
+	}
+
+	if(ponder)
+		pool.resume();
+	return ok;
+}
+
 }; // namespace Havannah
 }; // namespace Morat
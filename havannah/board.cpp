@@ -1,4 +1,6 @@
 
+#include "../lib/thread.h"
+
 #include "board.h"
 
 namespace Morat {
@@ -86,9 +88,15 @@ std::string Board::to_s(bool color, std::function<std::string(Move)> func) const
 	return s;
 }
 
-std::shared_ptr<MoveValid> Board::gen_neighbor_list() const {
-	std::shared_ptr<MoveValid> list(new MoveValid[vec_size()*18]);
-	MoveValid * a = list.get();
+//one list per board size, built the first time a board of that size is made and shared by all of them after that,
+//so copying a board never has to allocate or reference count
+const MoveValid * Board::gen_neighbor_list() const {
+	static MoveValid * lists[max_size + 1] = {};
+	if(lists[size_r_])
+		return lists[size_r_];
+
+	MoveValid * list = new MoveValid[vec_size()*18];
+	MoveValid * a = list;
 	for(int y = 0; y < size_; y++){
 		for(int x = 0; x < size_; x++){
 			Move pos(x,y);
@@ -101,6 +109,11 @@ std::shared_ptr<MoveValid> Board::gen_neighbor_list() const {
 		}
 	}
 
+	//another thread may have built it at the same time, only keep one of them
+	if(!CAS(lists[size_r_], (MoveValid *)NULL, list)){
+		delete[] list;
+		list = lists[size_r_];
+	}
 	return list;
 }
 
@@ -192,6 +205,11 @@ bool Board::followring(const MoveValid & cur, const int & dir, const Side & turn
 
 // do an O(1) ring check
 // must be done before placing the stone and joining it with the neighboring groups
+// Placing a stone changes the number of holes in its player's stones by the number of runs of their stones around it
+// minus the number of distinct groups those runs belong to (the change in the Euler characteristic), so two runs of
+// the same group close a ring around at least one other cell. A ring around only the player's own stones has no hole,
+// but then one of them is completely surrounded, which can only happen to this stone or a neighbor in the middle of
+// a run of 3 or more, checked with checkring_back
 bool Board::checkring_o1(const MoveValid & pos, const Side turn) const {
 	static const unsigned char ringdata[64][10] = {
 		{0, 0, 0, 0, 0, 0, 0, 0, 0, 0}, //000000
@@ -260,13 +278,13 @@ bool Board::checkring_o1(const MoveValid & pos, const Side turn) const {
 		{6, 0, 0, 0, 0, 0, 0, 0, 0, 0}, //111111
 	};
 
-	int bitpattern = 0;
+	//which neighbors are turn's, from the pattern so it doesn't need to look at them. Off the board is 3, never a side
+	int bitpattern = 0, t = turn.to_i();
+	Pattern p = pattern_small(pos);
+	for(int i = 0; i < 6; i++, p >>= 2)
+		bitpattern = (bitpattern << 1) | ((int)(p & 3) == t);
+
 	const MoveValid * s = neighbors(pos);
-	for (auto m : neighbors_small(pos)) {
-		bitpattern <<= 1;
-		if(m.on_board() && turn == get(m.xy))
-			bitpattern |= 1;
-	}
 
 	const unsigned char * d = ringdata[bitpattern];
 
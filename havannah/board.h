@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <cassert>
 #include <cstdio>
+#include <cstring>
 #include <functional>
 #include <memory>
 #include <ostream>
@@ -12,6 +13,7 @@
 
 #include "../lib/bitcount.h"
 #include "../lib/board_grid_hex.h"
+#include "../lib/board_journal.h"
 #include "../lib/board_shape_hex.h"
 #include "../lib/hashset.h"
 #include "../lib/move.h"
@@ -73,19 +75,37 @@ private:
 	Outcome outcome_;
 	int8_t win_type_;
 
-	std::vector<Cell> cells_;
 	Zobrist<12> hash;
-	std::shared_ptr<MoveValid> neighbor_list_;
+	const MoveValid * neighbor_list_; //shared by all boards of this size
+	BoardJournal<Cell> * journal_;    //saves what each move changes so it can be undone, see set_journal
 
 public:
 	bool check_rings; // whether to look for rings at all
 	int perm_rings;   // how many permanent stones are needed for a ring to count
 
+private:
+	//fixed size so copies are a flat memcpy without allocating, only the first vec_size() are used. It must stay the
+	//last member since copies stop at the end of the cells in use. It's in a union so the unused ones aren't
+	//constructed for each copy either
+	union {
+		Cell cells_[max_vec_size];
+	};
+
+public:
+
 	Board() = delete;
-	explicit Board(std::string s) {
+	explicit Board(std::string s) : journal_(NULL) {
 		assert(size(s));
 	}
 
+	Board(const Board & o) { *this = o; }
+	Board & operator = (const Board & o) {
+		//all the members are plain data, so copy everything up to the end of the cells in use
+		memcpy((void *)this, (const void *)&o, (const char *)(o.cells_ + o.vec_size()) - (const char *)&o);
+		journal_ = NULL; //a copy starts without one
+		return *this;
+	}
+
 	bool size(std::string s) {
 		if (!valid_size(s))
 			return false;
@@ -94,7 +114,6 @@ public:
 		size_ = size_r_ * 2 - 1;
 		neighbor_list_ = gen_neighbor_list();
 		num_cells_ = vec_size() - size_r_ * size_r_m1_;
-		cells_.resize(vec_size());
 		clear();
 		return true;
 	}
@@ -127,7 +146,7 @@ public:
 		return (min_size <= size && size <= max_size);
 	}
 
-	int mem_size() const { return sizeof(Board) + sizeof(Cell)*vec_size(); }
+	int mem_size() const { return sizeof(Board); }
 	int vec_size() const { return size_*size_; }
 	int num_cells() const { return num_cells_; }
 
@@ -298,6 +317,17 @@ public:
 		return m;
 	}
 
+	//while a journal is set, moves can be taken back with undo in the reverse order they were made, which is much
+	//cheaper than copying the board for each move when searching deep in a tree
+	void set_journal(BoardJournal<Cell> * journal) { journal_ = journal; }
+
+	//take back the last move, only valid for moves that succeeded while the journal was set
+	void undo() {
+		assert(journal_ && journal_->depth() > 0);
+		clear_pattern(move_valid(last_move_));
+		journal_->undo(this, cells_);
+	}
+
 	bool move(const Move & pos, bool checkwin = true, bool permanent = true) {
 		return move(MoveValid(pos, xy(pos)), checkwin, permanent);
 	}
@@ -307,9 +337,17 @@ public:
 		if(!valid_move(pos))
 			return false;
 
+		if(journal_)
+			journal_->begin(this, (const char *)cells_ - (const char *)this);
+
+		//when any stones can form a ring, look for one with the neighborhood before the groups are joined. That's O(1)
+		//instead of following the ring. With perm_rings some stones don't count, so follow it after joining instead
+		bool ring = (checkwin && check_rings && perm_rings <= 0 && checkring_o1(pos, to_play_));
+
 		last_move_ = pos;
 		num_moves_++;
 
+		save(pos.xy);
 		Cell& cell = cells_[pos.xy];
 		cell.piece = to_play_;
 		cell.perm = permanent;
@@ -336,7 +374,7 @@ public:
 			}else if(g->numcorners() >= 2){
 				outcome_ = +to_play_;
 				win_type_ = 1;
-			}else if(check_rings && alreadyjoined && g->size >= 6 && checkring_df(pos, to_play_)){
+			}else if(ring || (check_rings && perm_rings > 0 && alreadyjoined && g->size >= 6 && checkring_df(pos, to_play_))){
 				outcome_ = +to_play_;
 				win_type_ = 2;
 			}else if(num_moves_ == num_cells_){
@@ -388,7 +426,13 @@ private:
 	bool followring(const MoveValid & cur, const int & dir, const Side & turn, const int & permsneeded) const;
 	bool checkring_back(const MoveValid & a, const MoveValid & b, const MoveValid & c, Side turn) const;
 
-	std::shared_ptr<MoveValid> gen_neighbor_list() const;
+	const MoveValid * gen_neighbor_list() const;
+
+	//save a cell before changing it, so the move can be undone
+	void save(int i) const {
+		if(journal_)
+			journal_->save(i, cells_[i]);
+	}
 
 	int find_group(const MoveValid & m) const { return find_group(m.xy); }
 	int find_group(unsigned int i) const {
@@ -397,7 +441,10 @@ private:
 			do{
 				p = cells_[p].parent;
 			}while(p != cells_[p].parent);
-			cells_[i].parent = p; //do path compression, but only the current one, not all, to avoid recursion
+			//do path compression, but only the current one, not all, to avoid recursion. Skip it while keeping a journal,
+			//as saving every compression would cost more than it saves, and union by size keeps the groups shallow anyway
+			if(!journal_)
+				cells_[i].parent = p;
 		}
 		return p;
 	}
@@ -414,6 +461,8 @@ private:
 		if(cells_[i].size < cells_[j].size) //force i's subtree to be bigger
 			std::swap(i, j);
 
+		save(i);
+		save(j);
 		cells_[j].parent = i;
 		cells_[i].size   += cells_[j].size;
 		cells_[i].corner |= cells_[j].corner;
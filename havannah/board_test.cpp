@@ -1,6 +1,7 @@
 
 #include "../lib/catch.hpp"
 #include "../lib/string.h"
+#include "../lib/xorshift.h"
 
 #include "board.h"
 
@@ -197,3 +198,63 @@ TEST_CASE("Havannah::Board", "[havannah][board]") {
 		}, Outcome::DRAW, -1);
 	}
 }
+
+//play random moves, taking some back along the way, and check that each undo gives back exactly the board from
+//before the move
+void test_undo(Board b) {
+	BoardJournal<Board::Cell> journal;
+	b.set_journal(&journal);
+
+	XORShift_uint32 rand(42);
+	std::vector<Board> before;
+	for(int i = 0; i < 1000; i++) {
+		if(!before.empty() && (b.outcome() != Outcome::UNKNOWN || rand() % 3 == 0)) {
+			b.undo();
+			const Board & o = before.back();
+			CAPTURE(o);
+			REQUIRE(b.to_s(false) == o.to_s(false));
+			REQUIRE(b.gethash() == o.gethash());
+			REQUIRE(b.to_play() == o.to_play());
+			REQUIRE(b.moves_made() == o.moves_made());
+			REQUIRE(b.outcome() == o.outcome());
+			REQUIRE(b.win_type() == o.win_type());
+			for(auto m : o) // the groups are back as they were too
+				REQUIRE(b.test_outcome(m) == o.test_outcome(m));
+			before.pop_back();
+		} else {
+			std::vector<Move> moves;
+			for(auto m : b)
+				moves.push_back(m);
+			before.push_back(b);
+			REQUIRE(b.move(moves[rand() % moves.size()]));
+		}
+	}
+	REQUIRE(journal.depth() == before.size());
+}
+
+TEST_CASE("Havannah::Board undo", "[havannah][board]") {
+	test_undo(Board("4"));
+}
+
+//move finds rings with the O(1) check unless some stones need to be permanent, in which case it follows the ring.
+//Every stone here is permanent, so needing one permanent stone finds the same rings by following them
+TEST_CASE("Havannah::Board rings", "[havannah][board]") {
+	XORShift_uint32 rand(42);
+	int wrong = 0, rings = 0;
+	for(int size : {4, 6, 8}) {
+		for(int game = 0; game < 500; game++) {
+			Board o1(to_str(size)), df(to_str(size));
+			df.perm_rings = 1;
+			while(o1.outcome() == Outcome::UNKNOWN && df.outcome() == Outcome::UNKNOWN) {
+				std::vector<Move> moves;
+				for(auto m : o1)
+					moves.push_back(m);
+				Move m = moves[rand() % moves.size()];
+				wrong += (!o1.move(m) || !df.move(m) || o1.outcome() != df.outcome() || o1.win_type() != df.win_type());
+			}
+			rings += (o1.win_type() == 2);
+		}
+	}
+	REQUIRE(wrong == 0);
+	REQUIRE(rings > 100); // make sure it tested enough rings
+}
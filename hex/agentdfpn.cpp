@@ -0,0 +1,323 @@
+
+#include "../lib/alarm.h"
+#include "../lib/log.h"
+#include "../lib/time.h"
+
+#include "agentdfpn.h"
+
+
+namespace Morat {
+namespace Hex {
+
+void AgentDFPN::search(double time, uint64_t maxiters, int verbose){
+	reset();
+	max_nodes_seen = maxiters;
+
+	if(rootboard.outcome() >= 0)
+		return;
+
+	if(!tt.enabled())
+		tt.resize(memlimit);
+
+	Time starttime;
+
+	pool.reset();
+	pool.resume();
+
+	pool.wait_pause(time);
+
+
+	double time_used = Time() - starttime;
+
+
+	if(verbose){
+		DepthStats treelen;
+		for(auto & t : pool)
+			treelen += t->treelen;
+
+		logerr("Finished:    " + to_str(nodes_seen) + " nodes created in " + to_str(time_used*1000, 0) + " msec: " + to_str(nodes_seen/time_used, 0) + " Nodes/s\n");
+		if(nodes_seen > 0){
+			logerr("Tree depth:  " + treelen.to_s() + "\n");
+		}
+		logerr("Table:       " + to_str(tt.num_used()) + " of " + to_str(tt.entries()) + " entries used, " + to_str(tt.num_replaced()) + " replaced\n");
+
+		Side to_play = rootboard.to_play();
+
+		logerr("Root:        " + root.to_s() + "\n");
+		Outcome outcome = root.to_outcome(~to_play);
+		if(outcome != Outcome::UNKNOWN)
+			logerr("Solved as a " + outcome.to_s_rel(to_play) + "\n");
+
+		std::string pvstr;
+		for(auto m : Agent::get_pv())
+			pvstr += " " + m.to_s();
+		logerr("PV:         " + pvstr + "\n");
+
+		if(verbose >= 3)
+			logerr("Move stats:\n" + move_stats(vecmove()));
+	}
+}
+
+void AgentDFPN::AgentThread::iterate(){
+	Board board = agent->rootboard;
+	board.set_journal(&journal);
+	uint64_t seen_before = nodes_seen;
+	mid(board, 0, INF32/2, INF32/2, agent->root.phi, agent->root.delta);
+	agent->root.work += nodes_seen - seen_before;
+	assert(journal.depth() == 0);
+}
+
+void AgentDFPN::AgentThread::mid(Board & board, unsigned int depth, uint32_t tp, uint32_t td, uint32_t & phi, uint32_t & delta){
+	treelen.add(depth);
+
+	//a deque doesn't move the existing levels when it grows, so this stays valid through the recursion
+	if(stack.size() <= depth)
+		stack.resize(depth + 1);
+	std::vector<Node> & nodes = stack[depth];
+
+	agent->children(board, nodes);
+	nodes_seen += nodes.size();
+	agent->nodes_seen += nodes.size();
+
+	hash_t hash = board.gethash();
+	uint32_t p, d;
+	uint64_t work = 0;
+	agent->tt.find(hash, p, d, work);
+	uint64_t seen = nodes_seen;
+
+	while(true){
+		update(nodes, phi, delta);
+
+		//proven or over the thresholds, go back up to search a sibling
+		if(phi >= tp || delta >= td)
+			break;
+
+		if(agent->timeout || agent->done())
+			break;
+
+		Node * child = NULL,  // the best move to explore
+		     * child2 = NULL; // second best for thresholds
+
+		for(auto & i : nodes){
+			if(!child || i.delta <= child->delta){
+				child2 = child;
+				child = & i;
+			}else if(!child2 || i.delta < child2->delta){
+				child2 = & i;
+			}
+		}
+
+		//with no sibling to switch to, the only limit is the parent's
+		uint32_t tpc = std::min(INF32/2, (td + child->phi - delta));
+		uint32_t tdc = (child2 ? std::min(tp, (uint32_t)(child2->delta*(1.0 + agent->epsilon) + 1)) : tp);
+
+		board.move(child->move);
+		uint64_t seen_before = nodes_seen;
+		mid(board, depth + 1, tpc, tdc, child->phi, child->delta);
+		board.undo();
+		child->work += nodes_seen - seen_before;
+	}
+
+	agent->tt.store(hash, phi, delta, work + nodes_seen - seen);
+}
+
+void AgentDFPN::children(Board & board, std::vector<Node> & nodes) const {
+	nodes.resize(board.moves_avail());
+
+	unsigned int i = 0;
+	for (auto move : board) {
+		Node & node = nodes[i++];
+		node = Node(move);
+
+		//searched before, or a transposition of something that was
+		if(tt.find(board.test_hash(move), node.phi, node.delta, node.work))
+			continue;
+
+		unsigned int pd = 1;
+		Outcome outcome = board.test_outcome(move);
+
+		if(ab && outcome == Outcome::UNKNOWN){
+			board.move(move);
+
+			pd = 0;
+			outcome = (ab == 1 ? solve1ply(board, pd) : solve2ply(board, pd));
+			board.undo();
+		}
+
+		node.outcome(outcome, board.to_play(), ties, pd);
+	}
+	nodes.resize(i); //if symmetry, there may be extra moves to ignore
+}
+
+void AgentDFPN::update(const std::vector<Node> & nodes, uint32_t & phi, uint32_t & delta){
+	//no moves left but no winner either
+	if(nodes.empty()){
+		phi = 0;
+		delta = DRAW;
+		return;
+	}
+
+	uint32_t min = nodes[0].delta;
+	uint64_t sum = 0;
+
+	bool win = false;
+	for(auto & i : nodes){
+		win |= (i.phi == LOSS);
+		sum += i.phi;
+		if( min > i.delta)
+			min = i.delta;
+	}
+
+	if(win)
+		sum = LOSS;
+	else if(sum >= INF32)
+		sum = INF32;
+
+	if(sum == 0 && min == DRAW){
+		phi = 0;
+		delta = DRAW;
+	}else{
+		phi = min;
+		delta = sum;
+	}
+}
+
+
+double AgentDFPN::gamelen() const {
+	return rootboard.moves_remain();
+}
+
+Move AgentDFPN::best_move(const std::vector<Node> & nodes, Side to_play) const {
+	double val, maxval = -1000000000000.0; //1 trillion
+
+	const Node * ret = NULL;
+
+	for(auto & child : nodes){
+		Outcome outcome = child.to_outcome(to_play);
+		if(outcome >= Outcome::DRAW){
+			if(     outcome == +to_play)       val =  800000000000.0 - (double)child.work; //shortest win
+			else if(outcome == Outcome::DRAW) val = -400000000000.0 + (double)child.work; //longest tie
+			else                              val = -800000000000.0 + (double)child.work; //longest loss
+		}else{ //not proven
+			val = child.work;
+		}
+
+		if(maxval < val){
+			maxval = val;
+			ret = & child;
+		}
+	}
+
+	return (ret ? ret->move : Move(M_RESIGN));
+}
+
+Move AgentDFPN::return_move(int verbose) const {
+	BoardJournal<Board::Cell> journal;
+	Board board = rootboard;
+	board.set_journal(&journal);
+
+	std::vector<Node> nodes;
+	children(board, nodes);
+	Move best = best_move(nodes, board.to_play());
+
+	if(verbose){
+		for(auto & n : nodes)
+			if(n.move == best)
+				logerr(n.to_s() + "\n");
+	}
+
+	return best;
+}
+
+std::vector<Move> AgentDFPN::get_pv(const vecmove& moves) const {
+	vecmove pv;
+
+	BoardJournal<Board::Cell> journal;
+	Board board = rootboard;
+	board.set_journal(&journal);
+
+	std::vector<Node> nodes;
+	uint32_t phi, delta;
+	uint64_t work;
+	unsigned int i = 0;
+	//follow the moves given, then the best move for as long as the position has been searched
+	while(board.moves_avail() > 0 && (i < moves.size() || tt.find(board.gethash(), phi, delta, work))){
+		Move m;
+		if(i < moves.size()){
+			m = moves[i++];
+		}else{
+			children(board, nodes);
+			m = best_move(nodes, board.to_play());
+		}
+		if(!board.move(m))
+			break;
+		pv.push_back(m);
+	}
+
+	if(pv.size() == 0)
+		pv.push_back(Move(M_RESIGN));
+
+	return pv;
+}
+
+std::string AgentDFPN::move_stats(const vecmove& moves) const {
+	std::string s = "";
+
+	BoardJournal<Board::Cell> journal;
+	Board board = rootboard;
+	board.set_journal(&journal);
+
+	if(moves.size()){
+		s += "path:\n";
+		for(auto m : moves){
+			if(!board.move(m))
+				break;
+			Node n(m);
+			if(!tt.find(board.gethash(), n.phi, n.delta, n.work))
+				break;
+			s += n.to_s() + "\n";
+		}
+	}
+
+	std::vector<Node> nodes;
+	children(board, nodes);
+	s += "children:\n";
+	for(auto & n : nodes)
+		s += n.to_s() + "\n";
+	return s;
+}
+
+void AgentDFPN::gen_sgf(SGFPrinter<Move> & sgf, int limit) const {
+	if(limit < 0)
+		limit = root.work/1000;
+
+	BoardJournal<Board::Cell> journal;
+	Board board = rootboard;
+	board.set_journal(&journal);
+	gen_sgf(sgf, limit, board);
+}
+
+void AgentDFPN::gen_sgf(SGFPrinter<Move> & sgf, uint64_t limit, Board & board) const {
+	std::vector<Node> nodes;
+	children(board, nodes);
+
+	Node node;
+	update(nodes, node.phi, node.delta);
+
+	Side side = board.to_play();
+	for(auto & child : nodes){
+		//only what's been searched, as everything else is just a leaf evaluation
+		if(child.work > 0 && child.work >= limit && (side != node.to_outcome(~side) || child.to_outcome(side) == node.to_outcome(~side))){
+			sgf.child_start();
+			sgf.move(side, child.move);
+			sgf.comment(child.to_s());
+			board.move(child.move);
+			gen_sgf(sgf, limit, board);
+			board.undo();
+			sgf.child_end();
+		}
+	}
+}
+
+}; // namespace Hex
+}; // namespace Morat
@@ -0,0 +1,202 @@
+#pragma once
+
+//A depth-first proof number search (df-pn) solver. Unlike the pns agent it keeps no tree, only the numbers of the
+//positions it has searched in a fixed size table, and recomputes whatever gets replaced, so it can run on problems
+//bigger than memory without ever stopping to garbage collect. It runs in a single thread.
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "../lib/agentpool.h"
+#include "../lib/depthstats.h"
+#include "../lib/dfpntable.h"
+#include "../lib/log.h"
+#include "../lib/string.h"
+
+#include "agent.h"
+
+
+namespace Morat {
+namespace Hex {
+
+class AgentDFPN : public Agent {
+	static const uint32_t LOSS  = (1<<30)-1;
+	static const uint32_t DRAW  = (1<<30)-2;
+	static const uint32_t INF32 = (1<<30)-3;
+public:
+
+	//the numbers for a child of the position being searched, from the table or a leaf evaluation
+	struct Node {
+		uint32_t phi, delta;
+		uint64_t work;
+		Move move;
+
+		Node() { }
+		Node(const Move & m, int v = 1) : phi(v), delta(v), work(0), move(m) { }
+
+		Node & outcome(Outcome outcome, Side to_play, Side assign, int value = 1){
+			if(assign != Side::NONE && outcome == Outcome::DRAW)
+				outcome = +assign;
+
+			if(     outcome == Outcome::UNKNOWN) { phi = value; delta = value; }
+			else if(outcome == +to_play)          { phi = LOSS;  delta = 0;     }
+			else if(outcome == +~to_play)         { phi = 0;     delta = LOSS; }
+			else /*(outcome == Outcome::DRAW)*/  { phi = 0;     delta = DRAW; }
+			return *this;
+		}
+
+		Outcome to_outcome(Side to_play) const {
+			if(phi   == LOSS) return +to_play;
+			if(delta == LOSS) return +~to_play;
+			if(delta == DRAW) return Outcome::DRAW;
+			return Outcome::UNKNOWN;
+		}
+
+		bool terminal() const { return (phi == 0 || delta == 0); }
+
+		std::string to_s() const {
+			return "AgentDFPN::Node"
+			       ", move " + move.to_s() +
+			       ", phi " + to_str(phi) +
+			       ", delta " + to_str(delta) +
+			       ", work " + to_str(work);
+		}
+	};
+
+	class AgentThread : public AgentThreadBase<AgentDFPN> {
+		std::deque<std::vector<Node>> stack; //the children of each position on the current path, reused between calls
+		BoardJournal<Board::Cell> journal;
+	public:
+		DepthStats treelen;
+		uint64_t nodes_seen;
+
+		AgentThread(AgentThreadPool<AgentDFPN> * p, AgentDFPN * a) : AgentThreadBase<AgentDFPN>(p, a) { }
+
+		void reset(){
+			nodes_seen = 0;
+			treelen.reset();
+		}
+
+		void iterate(); //handles each iteration
+
+		//search the position until it's proven or its numbers pass the thresholds, then return them
+		void mid(Board & board, unsigned int depth, uint32_t tp, uint32_t td, uint32_t & phi, uint32_t & delta);
+	};
+
+
+	uint64_t memlimit;
+	DFPNTable tt;
+
+	AgentThreadPool<AgentDFPN> pool;
+
+	uint64_t nodes_seen, max_nodes_seen;
+
+	int   ab;      // how deep of an alpha-beta search to run at each leaf node
+	float epsilon; // how wide should the threshold be?
+	Side  ties;    // which player to assign ties to: 0 handle ties, 1 assign p1, 2 assign p2
+
+	Node root;
+
+	AgentDFPN() = delete;
+	AgentDFPN(const Board & b) : Agent(b), pool(this) {
+		ab = 2;
+		epsilon = 0.25;
+		ties = Side::NONE;
+		pool.set_num_threads(1);
+
+		root = Node(Move(M_NONE));
+		reset();
+
+		set_memlimit(1000*1024*1024);
+	}
+
+	~AgentDFPN(){
+		pool.pause();
+		pool.set_num_threads(0);
+	}
+
+	void reset(){
+		nodes_seen = 0;
+
+		timeout = false;
+	}
+
+	void set_board(const Board & board, bool clear = true){
+		pool.pause();
+		rootboard = board;
+		reset();
+		root = Node(Move(M_NONE));
+		if(clear)
+			clear_mem();
+	}
+	void move(const Move & m){
+		pool.pause();
+		rootboard.move(m);
+		reset();
+		root = Node(Move(M_NONE));
+	}
+
+	//the table is allocated on the next search
+	void set_memlimit(uint64_t lim){
+		pool.pause();
+		memlimit = lim;
+		tt.resize(0);
+	}
+
+	void clear_mem(){
+		pool.pause();
+		reset();
+		root = Node(Move(M_NONE));
+		tt.clear();
+	}
+
+	std::string mem_stats(){
+		pool.pause();
+		return "table: " + to_str(tt.memsize()/(1024*1024)) + " Mb, " + to_str(tt.entries()) + " entries, " +
+			to_str(tt.num_used()) + " used, " + to_str(tt.num_replaced()) + " replaced";
+	}
+
+	bool done() {
+		//solved or finished runs
+		return root.terminal() || (max_nodes_seen && nodes_seen >= max_nodes_seen);
+	}
+
+	bool need_gc() { return false; }
+	void start_gc() { }
+
+	void search(double time, uint64_t maxiters, int verbose);
+	Move return_move(int verbose) const;
+	double gamelen() const;
+	vecmove get_pv(const vecmove& moves) const;
+	std::string move_stats(const vecmove& moves) const;
+
+	void gen_sgf(SGFPrinter<Move> & sgf, int limit) const;
+
+	void load_sgf(SGFParser<Move> & sgf) {
+		logerr("load_sgf not supported in the dfpn agent.\n");
+	}
+
+	bool save_tree(const std::string & filename, const std::string & info) {
+		logerr("save_tree not supported in the dfpn agent.\n");
+		return false;
+	}
+
+	bool load_tree(const std::string & filename) {
+		logerr("load_tree not supported in the dfpn agent.\n");
+		return false;
+	}
+
+private:
+	//fill in the numbers for the children of this position from the table, or by evaluating them if they're not in it
+	void children(Board & board, std::vector<Node> & nodes) const;
+
+	//the numbers for the position from those of its children
+	static void update(const std::vector<Node> & nodes, uint32_t & phi, uint32_t & delta);
+
+	Move best_move(const std::vector<Node> & nodes, Side to_play) const;
+	void gen_sgf(SGFPrinter<Move> & sgf, uint64_t limit, Board & board) const;
+};
+
+}; // namespace Hex
+}; // namespace Morat
@@ -0,0 +1,41 @@
+
+#include "../lib/catch.hpp"
+
+#include "agentdfpn.h"
+#include "agentpns.h"
+
+
+using namespace Morat;
+using namespace Hex;
+
+TEST_CASE("Hex::AgentDFPN solves like AgentPNS", "[hex][agentdfpn]") {
+	Board board("4");
+
+	AgentPNS pns(board);
+	while(!pns.root.terminal())
+		pns.search(10, 0, 0);
+	Outcome expected = pns.root.to_outcome(~board.to_play());
+	REQUIRE(expected != Outcome::UNKNOWN);
+
+	// a table much smaller than the search still gets there, it just redoes the work it replaced
+	for(uint64_t mem : {1024*1024, 4*1024}){
+		AgentDFPN dfpn(board);
+		dfpn.set_memlimit(mem);
+		while(!dfpn.root.terminal())
+			dfpn.search(10, 0, 0);
+
+		REQUIRE(dfpn.root.to_outcome(~board.to_play()) == expected);
+		REQUIRE(dfpn.tt.memsize() <= mem);
+
+		Move best = dfpn.return_move(0);
+		REQUIRE(board.valid_move(best));
+		if(expected == +board.to_play()){
+			Board next = board;
+			next.move(best);
+			AgentDFPN check(next);
+			check.set_memlimit(mem);
+			check.search(10, 0, 0);
+			REQUIRE(check.root.to_outcome(~next.to_play()) == expected);
+		}
+	}
+}
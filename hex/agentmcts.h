@@ -5,6 +5,8 @@
 
 #include <cmath>
 #include <cassert>
+#include <deque>
+#include <vector>
 
 #include "../lib/agentpool.h"
 #include "../lib/compacttree.h"
@@ -19,6 +21,8 @@
 #include "../lib/policy_random.h"
 #include "../lib/thread.h"
 #include "../lib/time.h"
+#include "../lib/timemanager.h"
+#include "../lib/transtable.h"
 #include "../lib/types.h"
 #include "../lib/xorshift.h"
 
@@ -74,6 +78,14 @@ public:
 		std::string to_s() const ;
 		bool from_s(std::string s);
 
+		//whether this node was lazily expanded and some moves aren't children yet. A full expansion has every move
+		//as a child, or 1 for a macro move, while a lazy one has at least 2 but not all, so the children alone tell,
+		//no matter what widen has been set to since
+		bool partial(const Board & board) const {
+			unsigned int num = children.num();
+			return (num > 1 && num < (unsigned int)board.moves_avail());
+		}
+
 		unsigned int size() const {
 			unsigned int num = children.num();
 
@@ -146,6 +158,14 @@ public:
 
 		MoveList<Board> movelist;
 		int stage; //which of the four MCTS stages is it on
+		CompactTree<Node>::Arena arena; //thread local memory for creating children
+		std::vector<Node> candidates; //all the moves of a lazily expanded node, before choosing which become children
+
+		//runs and root experience are batched up so the threads don't all fight over the same cache lines every run
+		static const uint flushruns = 16;
+		static const uint disposeblocks = 64; //blocks of the old tree to free per run while there are any
+		uint     pendingruns;
+		ExpPair  pendingexp;
 
 	public:
 		DepthStats treelen, gamelen;
@@ -153,9 +173,18 @@ public:
 		double times[4]; //time spent in each of the stages
 		Time timestamps[4]; //timestamps for the beginning, before child creation, before rollout, after rollout
 
-		AgentThread(AgentThreadPool<AgentMCTS> * p, AgentMCTS * a) : AgentThreadBase<AgentMCTS>(p, a) { }
+		AgentThread(AgentThreadPool<AgentMCTS> * p, AgentMCTS * a) : AgentThreadBase<AgentMCTS>(p, a), arena(a->ctmem), candidates(Board::max_vec_size), pendingruns(0) { }
 
 
+		void flush(){
+			if(pendingruns){
+				PLUS(agent->runs, pendingruns);
+				agent->root.exp.addv(pendingexp);
+				pendingruns = 0;
+				pendingexp.clear();
+			}
+		}
+
 		void reset(){
 			treelen.reset();
 			gamelen.reset();
@@ -176,6 +205,7 @@ public:
 		void iterate(); //handles each iteration
 		void walk_tree(Board & board, Node * node, int depth);
 		bool create_children(const Board & board, Node * node);
+		void add_children(const Board & board, Node * node, unsigned int have, unsigned int num);
 		void add_knowledge(const Board & board, Node * node, Node * child);
 		Node * choose_move(const Node * node, Side to_play, int remain) const;
 		void update_rave(const Node * node, Side to_play);
@@ -194,6 +224,7 @@ public:
 	bool  ponder;     //think during opponents time?
 	int   numthreads; //number of player threads to run
 	u64   maxmem;     //maximum memory for the tree in bytes
+	uint  gcchunks;   //chunks of the tree to compact per pause while the search continues in between, 0 for all at once
 	bool  profile;    //count how long is spent in each stage of MCTS
 //final move selection
 	float msrave;     //rave factor in final move selection, -1 means use number instead of value
@@ -215,7 +246,9 @@ public:
 	bool  keeptree;   //reuse the tree from the previous move
 	int   minimax;    //solve the minimax tree within the uct tree
 	uint  visitexpand;//number of visits before expanding a node
+	uint  widen;      //lazy expansion, only create the best widen children by knowledge and add more as visits grow, 0 for all
 	uint  gcsolved;   //garbage collect solved nodes or keep them in the tree, assuming they meet the required amount of work
+	uint  ttmin;      //the experience a transposition needs in the table before it's used as the prior of a new node
 	bool  longestloss;//if we have a proven loss, if true backup the longest loss, else backup the hardest loss to solve
 
 //knowledge
@@ -230,16 +263,26 @@ public:
 	bool  rolloutpattern; //play the response to a virtual connection threat in rollouts
 	int   lastgoodreply;  //use the last-good-reply rollout heuristic
 	int   instantwin;     //how deep to look for instant wins in rollouts
+	bool  fillboard;      //fill the whole board in rollouts and find the winner once at the end, see Board::fill
 
 	float gammas[4096]; //pattern weights for weighted random
 
 	Node  root;
 	uword nodes;
 	int   gclimit; //the minimum experience needed to not be garbage collected
+	float gcremains; //stats of the garbage collection in progress, reported once compaction finishes
+	float gcmsec;
 
 	uint64_t runs, maxruns;
+	TimeManager timeman; //stops early or extends timed searches based on how settled the root is
+	double clock; //time left on the game clock for this move, searches are never extended past it, 0 for no clock
+	bool   flexible; //whether the clock keeps the time a move doesn't use, searches are only stopped early or extended if it does
 
 	CompactTree<Node> ctmem;
+	CompactTree<Node>::Disposer garbage; //the rest of the tree after a move, freed by the threads as they search
+	SpinLock widenlock;       //held while adding children to a lazily expanded node
+	std::deque<Node> retired; //children replaced by a wider set, kept until no thread can still be walking them
+	TransTable tt; //experience shared between transpositions, disabled unless given a size
 
 	AgentThreadPool<AgentMCTS> pool;
 
@@ -251,6 +294,8 @@ public:
 	void clear_mem() { };
 
 	void set_ponder(bool p);
+	void set_ttsize(uint64_t bytes);
+	std::string mem_stats();
 	void set_board(const Board & board, bool clear = true);
 
 	void move(const Move & m);
@@ -264,24 +309,56 @@ public:
 
 	bool done() {
 		//solved or finished runs
-		return (rootboard.outcome() >= Outcome::DRAW || root.outcome >= Outcome::DRAW || (maxruns > 0 && runs >= maxruns));
+		return (rootboard.outcome() >= Outcome::DRAW || root.outcome >= Outcome::DRAW || (maxruns > 0 && runs >= maxruns) ||
+		        (timeman.due() && check_time()));
+	}
+
+	void free_retired() {
+		//only call when the threads are paused
+		for(auto & n : retired){
+			for(Node * c = n.children.begin(); c != n.children.end(); c++)
+				c->children.unlock(); //locked while being replaced, so no thread could give them children
+			nodes -= n.dealloc(ctmem);
+		}
+		retired.clear();
+	}
+
+	void free_garbage() {
+		//only call when the threads are paused
+		nodes -= garbage.clear(ctmem);
 	}
 
 	bool need_gc() {
+		//continue an incremental compaction once the threads have had time to search
+		if(ctmem.compacting())
+			return ctmem.compact_due();
 		//out of memory, start garbage collection
 		return (ctmem.memalloced() >= maxmem);
 	}
 
 	void start_gc() {
-		Time starttime;
-		logerr("Starting player GC with limit " + to_str(gclimit) + " ... ");
-		uint64_t nodesbefore = nodes;
-		garbage_collect(root, rootboard.to_play());
-		Time gctime;
-		ctmem.compact(1.0, 0.75);
-		Time compacttime;
-		logerr(to_str(100.0*nodes/nodesbefore, 1) + " % of tree remains - " +
-			to_str((gctime - starttime)*1000, 0)  + " msec gc, " + to_str((compacttime - gctime)*1000, 0) + " msec compact\n");
+		free_retired();
+		free_garbage();
+		if(!ctmem.compacting()){
+			Time starttime;
+			logerr("Starting player GC with limit " + to_str(gclimit) + " ... ");
+			uint64_t nodesbefore = nodes;
+			garbage_collect(root, rootboard.to_play());
+			gcremains = 100.0*nodes/nodesbefore;
+			gcmsec = (Time() - starttime)*1000;
+			if(tt.enabled())
+				tt.gc(ttmin);
+			ctmem.compact_start(1.0, 0.75, gcchunks > 0);
+		}
+		if(!ctmem.compact_step(gcchunks))
+			return;
+
+		const DepthStats & pauses = ctmem.compact_pauses();
+		logerr(to_str(gcremains, 1) + " % of tree remains - " +
+			to_str(gcmsec, 0) + " msec gc, " + to_str(pauses.sumdepth/1000.0, 0) + " msec compact");
+		if(pauses.num > 1)
+			logerr(" in " + to_str(pauses.num) + " steps, avg " + to_str(pauses.avg()/1000, 1) + ", max " + to_str(pauses.maxdepth/1000.0, 1) + " msec");
+		logerr("\n");
 
 		if(ctmem.meminuse() >= maxmem/2)
 			gclimit = (int)(gclimit*1.3);
@@ -299,9 +376,13 @@ public:
 		load_sgf(sgf, rootboard, root);
 	}
 
+	bool save_tree(const std::string & filename, const std::string & info);
+	bool load_tree(const std::string & filename);
+
 protected:
 	void garbage_collect(Node& node, Side to_play);
-	bool do_backup(Node * node, const Node * backup, Side to_play);
+	bool check_time();
+	bool do_backup(Node * node, const Node * backup, Side to_play, bool partial = false);
 	Move return_move(const Node * node, Side to_play, int verbose = 0) const;
 
 	Node * find_child(const Node * node, const Move & move) const ;
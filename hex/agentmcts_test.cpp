@@ -14,3 +14,44 @@ TEST_CASE("Hex::AgentMCTS::Node::to_s/from_s", "[hex][agentmcts]") {
 	REQUIRE(k.from_s(s));
 	REQUIRE(n.to_s() == k.to_s());
 }
+
+TEST_CASE("Hex::AgentMCTS lazy expansion", "[hex][agentmcts]") {
+	Board b("7");
+	AgentMCTS full(b), lazy(b);
+	lazy.widen = 4;
+	lazy.numthreads = 2;
+	lazy.pool.set_num_threads(lazy.numthreads);
+
+	full.search(0, 100, 0);
+	lazy.search(0, 100, 0);
+
+	REQUIRE(full.root.children.num() == (unsigned int)b.moves_avail());
+	REQUIRE(lazy.root.children.num() >= 4);
+	REQUIRE(lazy.root.children.num() < (unsigned int)b.moves_avail());
+	REQUIRE(lazy.nodes < full.nodes);
+
+	REQUIRE(lazy.nodes > lazy.root.size()); //counts the children replaced by wider sets
+	lazy.free_retired();
+	REQUIRE(lazy.nodes == lazy.root.size());
+
+	lazy.widen = 0; //nodes already expanded lazily are still missing moves
+	REQUIRE(lazy.root.partial(b));
+	REQUIRE_FALSE(full.root.partial(b));
+	lazy.search(0, 100, 0);
+	REQUIRE(lazy.root.outcome == Outcome::UNKNOWN);
+}
+
+TEST_CASE("Hex::AgentMCTS move frees the old tree while searching", "[hex][agentmcts]") {
+	Board b("7");
+	AgentMCTS agent(b);
+
+	agent.search(0, 1000, 0);
+	uword before = agent.nodes;
+	agent.move(agent.return_move(0));
+	REQUIRE(agent.nodes == before); //nothing is freed yet
+	REQUIRE_FALSE(agent.garbage.empty());
+
+	agent.search(0, 100, 0);
+	REQUIRE(agent.garbage.empty());
+	REQUIRE(agent.nodes == agent.root.size());
+}
@@ -11,19 +11,29 @@ namespace Morat {
 namespace Hex {
 
 void AgentMCTS::AgentThread::iterate(){
-	INCR(agent->runs);
+	if(!agent->garbage.empty()){
+		uword freed = agent->garbage.step(arena, disposeblocks);
+		if(freed){
+			PLUS(agent->nodes, -freed);
+			if(agent->garbage.empty())
+				logerr("Freed " + to_str(agent->garbage.num_freed()) + " nodes of the old tree while searching\n");
+		}
+	}
+
 	if(agent->profile){
 		timestamps[0] = Time();
 		stage = 0;
 	}
 
 	movelist.reset(&(agent->rootboard));
-	agent->root.exp.addvloss();
 	Board copy = agent->rootboard;
 	use_rave    = (unitrand() < agent->userave);
 	use_explore = (unitrand() < agent->useexplore);
 	walk_tree(copy, & agent->root, 0);
-	agent->root.exp.addv(movelist.getexp(~agent->rootboard.to_play()));
+	pendingexp.addloss(); //the root is the same for every run, so there's no need for a virtual loss
+	pendingexp += movelist.getexp(~agent->rootboard.to_play());
+	if(++pendingruns >= flushruns || (agent->maxruns > 0 && agent->runs + pendingruns >= agent->maxruns))
+		flush();
 
 	if(agent->profile){
 		times[0] += timestamps[1] - timestamps[0];
@@ -37,12 +47,32 @@ void AgentMCTS::AgentThread::walk_tree(Board & board, Node * node, int depth){
 	Side to_play = board.to_play();
 
 	if(!node->children.empty() && node->outcome < Outcome::DRAW){
+		bool lazy = node->partial(board);
+		if(lazy){ //progressive widening, consider widen + sqrt(visits) children, adding them in batches
+			unsigned int have = node->children.num();
+			if(have < agent->widen + std::sqrt((float)node->exp.num())){
+				add_children(board, node, have, 2*have);
+				lazy = node->partial(board);
+			}
+		}
+
 	//choose a child and recurse
 		Node * child;
 		do{
 			int remain = board.moves_remain();
 			child = choose_move(node, to_play, remain);
 
+			if(!child) //another thread moved the children to a wider copy of this node, so treat it as a leaf
+				break;
+
+			if(lazy && child->outcome >= Outcome::DRAW && child->outcome != to_play){
+				//all the children so far are decided, but the moves not yet added may not be
+				unsigned int have = node->children.num();
+				add_children(board, node, have, 2*have);
+				lazy = node->partial(board);
+				continue;
+			}
+
 			if(child->outcome < Outcome::DRAW){
 				movelist.addtree(child->move, to_play);
 
@@ -51,13 +81,16 @@ void AgentMCTS::AgentThread::walk_tree(Board & board, Node * node, int depth){
 					assert(false && "move failed");
 				}
 
+				hash_t hash = (agent->tt.enabled() ? board.gethash() : 0);
 				child->exp.addvloss(); //balanced out after rollouts
 
 				walk_tree(board, child, depth+1);
 
 				child->exp.addv(movelist.getexp(to_play));
+				if(hash)
+					agent->tt.add(hash, movelist.getexp(to_play));
 
-				if(!agent->do_backup(node, child, to_play) && //not solved
+				if(!agent->do_backup(node, child, to_play, lazy) && //not solved
 					agent->ravefactor > min_rave &&  //using rave
 					node->children.num() > 1 &&       //not a macro move
 					50*remain*(agent->ravefactor + agent->decrrave*remain) > node->exp.num()) //rave is still significant
@@ -65,9 +98,10 @@ void AgentMCTS::AgentThread::walk_tree(Board & board, Node * node, int depth){
 
 				return;
 			}
-		}while(!agent->do_backup(node, child, to_play));
+		}while(!agent->do_backup(node, child, to_play, lazy));
 
-		return;
+		if(child)
+			return;
 	}
 
 	if(agent->profile && stage == 0){
@@ -118,6 +152,18 @@ bool sort_node_know(const AgentMCTS::Node & a, const AgentMCTS::Node & b){
 	return (a.know > b.know);
 }
 
+//copy the num nodes with the most knowledge from [begin, end) to out, in decreasing order
+void copy_best_know(AgentMCTS::Node * begin, AgentMCTS::Node * end, unsigned int num, AgentMCTS::Node * out){
+	AgentMCTS::Node * order[Board::max_vec_size];
+	unsigned int n = 0;
+	for(AgentMCTS::Node * i = begin; i != end; i++)
+		order[n++] = i;
+	std::partial_sort(order, order + num, order + n,
+		[](const AgentMCTS::Node * a, const AgentMCTS::Node * b){ return (a->know > b->know); });
+	for(unsigned int i = 0; i < num; i++)
+		out[i] = *order[i];
+}
+
 bool AgentMCTS::AgentThread::create_children(const Board & board, Node * node){
 	if(!node->children.lock())
 		return false;
@@ -126,18 +172,28 @@ bool AgentMCTS::AgentThread::create_children(const Board & board, Node * node){
 		dists.run(&board, (agent->dists > 0), board.to_play());
 	}
 
+	//a lazy expansion fills in all the moves as candidates, then only keeps the best few as children
+	bool lazy = (agent->widen && (unsigned int)board.moves_avail() > agent->widen);
 	CompactTree<Node>::Children temp;
-	temp.alloc(board.moves_avail(), agent->ctmem);
+	if(!lazy)
+		temp.alloc(board.moves_avail(), arena);
 
 	Side to_play = board.to_play();
 	Side opponent = ~to_play;
 	int losses = 0;
 
-	Node * child = temp.begin(),
+	Node * begin = (lazy ? &candidates[0] : temp.begin()),
+	     * child = begin,
 	     * loss  = NULL;
 	for (auto move : board) {
 		*child = Node(move);
 
+		if(agent->tt.enabled()){ //use what a transposition learned as the prior, unless it's too little to trust
+			ExpPair exp;
+			if(agent->tt.find(board.test_hash(move), exp) && exp.num() >= agent->ttmin)
+				child->rave = exp;
+		}
+
 		if(agent->minimax){
 			child->outcome = board.test_outcome(move);
 
@@ -151,7 +207,7 @@ bool AgentMCTS::AgentThread::create_children(const Board & board, Node * node){
 				node->proofdepth = 1;
 				node->bestmove = move;
 				node->children.unlock();
-				temp.dealloc(agent->ctmem);
+				temp.dealloc(arena);
 				return true;
 			}
 		}
@@ -160,13 +216,13 @@ bool AgentMCTS::AgentThread::create_children(const Board & board, Node * node){
 			add_knowledge(board, node, child);
 		child++;
 	}
-	assert(child == temp.end());
+	assert(child == begin + board.moves_avail());
 
 	//Make a macro move, add experience to the move so the current simulation continues past this move
 	if(losses == 1){
 		Node macro = *loss;
-		temp.dealloc(agent->ctmem);
-		temp.alloc(1, agent->ctmem);
+		temp.dealloc(arena);
+		temp.alloc(1, arena);
 		macro.exp.addwins(agent->visitexpand);
 		*(temp.begin()) = macro;
 	}else if(losses >= 2){ //proven loss, but at least try to block one of them
@@ -174,11 +230,12 @@ bool AgentMCTS::AgentThread::create_children(const Board & board, Node * node){
 		node->proofdepth = 2;
 		node->bestmove = loss->move;
 		node->children.unlock();
-		temp.dealloc(agent->ctmem);
+		temp.dealloc(arena);
 		return true;
-	}
-
-	if(agent->dynwiden > 0) //sort in decreasing order by knowledge
+	}else if(lazy){ //keep the best by knowledge, sorted, since they're all that choose_move will see for a while
+		temp.alloc(agent->widen, arena);
+		copy_best_know(begin, child, agent->widen, temp.begin());
+	}else if(agent->dynwiden > 0) //sort in decreasing order by knowledge
 		std::sort(temp.begin(), temp.end(), sort_node_know);
 
 	PLUS(agent->nodes, temp.num());
@@ -188,6 +245,69 @@ bool AgentMCTS::AgentThread::create_children(const Board & board, Node * node){
 	return true;
 }
 
+//Add the next best moves by knowledge to a lazily expanded node that has have children, up to num of them. The current
+//children are copied to a new, wider, set and their subtrees moved over, and the old set is retired rather than
+//freed, since other threads may still be walking it. Their updates to the old set are lost, which is rare and harmless.
+void AgentMCTS::AgentThread::add_children(const Board & board, Node * node, unsigned int have, unsigned int num){
+	agent->widenlock.lock();
+	if(have == 0 || node->children.num() != have){ //another thread got here first
+		agent->widenlock.unlock();
+		return;
+	}
+
+	if(agent->dists){
+		dists.run(&board, (agent->dists > 0), board.to_play());
+	}
+
+	bool present[Board::max_vec_size] = {};
+	for(Node * c = node->children.begin(); c != node->children.end(); c++)
+		present[board.xy(c->move)] = true;
+
+	Node * begin = &candidates[0],
+	     * child = begin;
+	for (auto move : board) {
+		if(present[board.xy(move)])
+			continue;
+
+		*child = Node(move);
+
+		if(agent->tt.enabled()){
+			ExpPair exp;
+			if(agent->tt.find(board.test_hash(move), exp) && exp.num() >= agent->ttmin)
+				child->rave = exp;
+		}
+
+		if(agent->minimax)
+			child->outcome = board.test_outcome(move);
+
+		if(agent->knowledge)
+			add_knowledge(board, node, child);
+		child++;
+	}
+	assert(child == begin + board.moves_avail() - have);
+
+	unsigned int add = std::min(num - have, (unsigned int)(child - begin));
+
+	CompactTree<Node>::Children temp;
+	temp.alloc(have + add, arena);
+	Node * n = temp.begin();
+	for(Node * c = node->children.begin(); c != node->children.end(); c++, n++){
+		*n = *c;
+		if(c->children.num())
+			n->swap_tree(*c);
+		else
+			c->children.lock(); //if another thread is creating them, they'll be freed with the old set
+	}
+	copy_best_know(begin, child, add, n);
+
+	PLUS(agent->nodes, temp.num());
+	node->children.swap(temp);
+
+	agent->retired.emplace_back();
+	agent->retired.back().children.swap(temp);
+	agent->widenlock.unlock();
+}
+
 AgentMCTS::Node * AgentMCTS::AgentThread::choose_move(const Node * node, Side to_play, int remain) const {
 	float val, maxval = -1000000000;
 	float logvisits = log(node->exp.num());
@@ -199,8 +319,9 @@ AgentMCTS::Node * AgentMCTS::AgentThread::choose_move(const Node * node, Side to
 		explore *= node->exp.avg();
 
 	Node * ret   = NULL,
-		 * child = node->children.begin(),
-		 * end   = node->children.end();
+		 * end   = NULL,
+		 * begin = node->children.range(end),
+		 * child = begin;
 
 	for(; child != end && dynwidenlim >= 0; child++){
 		if(child->outcome >= Outcome::DRAW){
@@ -236,7 +357,7 @@ backup in this order:
 0 lose
 return true if fully solved, false if it's unknown or partially unknown
 */
-bool AgentMCTS::do_backup(Node * node, const Node * backup, Side to_play){
+bool AgentMCTS::do_backup(Node * node, const Node * backup, Side to_play, bool partial){
 	Outcome node_outcome = node->outcome;
 	if(node_outcome >= Outcome::DRAW) //already proven, probably by a different thread
 		return true;
@@ -244,12 +365,18 @@ bool AgentMCTS::do_backup(Node * node, const Node * backup, Side to_play){
 	if(backup->outcome == Outcome::UNKNOWN) //nothing proven by this child, so no chance
 		return false;
 
+	if(partial && backup->outcome != to_play) //only a win can be proven without all the moves as children
+		return false;
+
 	uint8_t proofdepth = backup->proofdepth;
 	if(backup->outcome != to_play){
 		int best_outcome = 0;
 		backup = NULL;
 
-		for (const auto& child : node->children) {
+		Node * end = NULL,
+		     * begin = node->children.range(end);
+		for (Node * c = begin; c != end; c++) {
+			const Node & child = *c;
 			Outcome child_outcome = child.outcome; //save a copy to avoid race conditions
 			int outcome = 0;
 
@@ -312,21 +439,24 @@ bool AgentMCTS::do_backup(Node * node, const Node * backup, Side to_play){
 
 		if(best_outcome == 3) //no win, but found an unknown
 			return false;
+
+		if(backup == NULL) //the children were just moved to a wider copy of this node
+			return false;
 	}
 
 	if(node->outcome.cas(node_outcome, backup->outcome)){
 		node->bestmove = backup->move;
 		node->proofdepth = proofdepth + 1;
 	}else //if it was in a race, try again, might promote a partial solve to full solve
-		return do_backup(node, backup, to_play);
+		return do_backup(node, backup, to_play, partial);
 
 	return (node->outcome >= Outcome::DRAW);
 }
 
 //update the rave score of all children that were played
 void AgentMCTS::AgentThread::update_rave(const Node * node, Side to_play){
-	Node * child = node->children.begin(),
-	     * childend = node->children.end();
+	Node * childend = NULL,
+	     * child = node->children.range(childend);
 
 	for( ; child != childend; ++child)
 		child->rave.addv(movelist.getrave(to_play, child->move));
@@ -419,14 +549,25 @@ Outcome AgentMCTS::AgentThread::rollout(Board & board, Move move, int depth){
 
 	random_policy.rollout_start(board);
 
+	//instant wins need the groups, which filling the board doesn't keep
+	bool fill = (agent->fillboard && !agent->instantwin);
+
 	while((won = board.outcome()) < Outcome::DRAW){
+		if(fill && board.moves_avail() == 0){
+			won = board.finish_fill();
+			break;
+		}
+
 		Side turn = board.to_play();
 
 		move = rollout_choose_move(board, move);
 
 		movelist.addrollout(move, turn);
 
-		assert2(board.move(move, true, false), "\n" + board.to_s(true) + "\n" + move.to_s());
+		if(fill)
+			board.fill(move);
+		else
+			assert2(board.move(move, true, false), "\n" + board.to_s(true) + "\n" + move.to_s());
 		depth++;
 	}
 
@@ -14,3 +14,100 @@ TEST_CASE("Hex::AgentPNS::Node::to_s/from_s", "[hex][agentpns]") {
 	REQUIRE(k.from_s(s));
 	REQUIRE(n.to_s() == k.to_s());
 }
+
+TEST_CASE("Hex::AgentPNS transposition table", "[hex][agentpns]") {
+	Board board("4");
+	Outcome expected = Outcome::UNKNOWN;
+
+	for(int tt : {0, 1, 2}){
+		AgentPNS agent(board);
+		agent.set_ttsize(tt ? 1024*1024 : 0);
+		agent.ttseed = (tt == 2);
+		while(!agent.root.terminal())
+			agent.search(10, 0, 0);
+
+		// the table changes how much work it takes, not the answer
+		Outcome outcome = agent.root.to_outcome(~board.to_play());
+		if(tt == 0)
+			expected = outcome;
+		REQUIRE(outcome != Outcome::UNKNOWN);
+		REQUIRE(outcome == expected);
+		REQUIRE(agent.tt.enabled() == (tt > 0));
+	}
+}
+
+TEST_CASE("Hex::AgentPNS checkpoint and resume", "[hex][agentpns]") {
+	char name[] = "/tmp/agentpns_test_XXXXXX";
+	int fd = mkstemp(name);
+	REQUIRE(fd >= 0);
+	close(fd);
+
+	Board board("4");
+
+	AgentPNS agent(board);
+	agent.epsilon = 0.5;
+	agent.search(0.005, 0, 0);
+
+	// checkpoints overwrite the last one
+	agent.set_checkpoint(name, 3600);
+	agent.checkpoint_info = "moves: \n";
+	agent.start_checkpoint();
+	agent.finish_checkpoint();
+
+	AgentPNS resumed(board);
+	REQUIRE(resumed.load_tree(name));
+	unlink(name);
+
+	REQUIRE(resumed.nodes == agent.nodes);
+	REQUIRE(resumed.nodes_seen == agent.nodes_seen);
+	REQUIRE(resumed.gclimit == agent.gclimit);
+	REQUIRE(resumed.epsilon == agent.epsilon);
+	REQUIRE(resumed.root.to_s() == agent.root.to_s());
+
+	// and it carries on to the same answer
+	while(!agent.root.terminal())
+		agent.search(10, 0, 0);
+	while(!resumed.root.terminal())
+		resumed.search(10, 0, 0);
+	REQUIRE(resumed.root.to_outcome(~board.to_play()) == agent.root.to_outcome(~board.to_play()));
+}
+
+TEST_CASE("Hex::AgentPNS threads in jobs", "[hex][agentpns]") {
+	Board board("4");
+	Outcome expected = Outcome::UNKNOWN;
+
+	for(unsigned int jobdepth : {0, 1, 2, 3}){
+		AgentPNS agent(board);
+		agent.jobdepth = jobdepth;
+		agent.numthreads = 4;
+		agent.pool.set_num_threads(agent.numthreads);
+		while(!agent.root.terminal())
+			agent.search(10, 0, 0);
+
+		// where the threads work changes how much work it takes, not the answer
+		Outcome outcome = agent.root.to_outcome(~board.to_play());
+		if(jobdepth == 0)
+			expected = outcome;
+		REQUIRE(outcome != Outcome::UNKNOWN);
+		REQUIRE(outcome == expected);
+
+		// every claim was given back
+		for(auto & child : agent.root.children)
+			REQUIRE_FALSE(child.claimed());
+	}
+}
+
+TEST_CASE("Hex::AgentPNS::Node compact", "[hex][agentpns]") {
+#ifdef PNS_COMPACT
+	REQUIRE(sizeof(AgentPNS::Node) == 16);
+#endif
+
+	// the work survives a round trip through a string, as close as the node can hold it
+	AgentPNS::Node n(Move("a1"), 3, 5);
+	n.work = 123456;
+	AgentPNS::Node k;
+	REQUIRE(k.from_s(n.to_s()));
+	REQUIRE(k.work == n.work);
+	REQUIRE(k.phi == 3u);
+	REQUIRE(k.delta == 5u);
+}
@@ -181,6 +181,7 @@ public:
 
 	virtual void init() { }  // for setting up the subclass's variables
 	virtual void reset() { } // for getting ready for the next search
+	virtual void flush() { } // for publishing thread local results, called whenever the thread stops running
 
 	int join(){ return thread.join(); }
 
@@ -200,6 +201,7 @@ private:
 				break;
 
 			case Thread_Wait_End:   //threads are waiting to end
+				flush();
 				pool->run_barrier.wait();
 				CAS(pool->thread_state, Thread_Wait_End, Thread_Wait_Start);
 				break;
@@ -218,6 +220,7 @@ private:
 
 			case Thread_GC:         //one thread is running garbage collection, the rest are waiting
 			case Thread_GC_End:     //once done garbage collecting, go to wait_end instead of back to running
+				flush();
 				if(pool->gc_barrier.wait()){
 					agent->start_gc();
 					CAS(pool->thread_state, Thread_GC,     Thread_Running);
@@ -0,0 +1,101 @@
+#pragma once
+
+//A set of cells on a hex grid, one bit per cell, laid out like the boards with cell x,y at bit y*size + x. The whole
+//set can take a step in all six directions at once with a few shifts and masks, so following connections is a flood
+//fill over words instead of cells. That's cheap enough to find the winner of a full board once instead of tracking
+//groups move by move.
+
+#include <stdint.h>
+
+namespace Morat {
+
+template<int max_cells>
+class BitboardHex {
+	static const int words = (max_cells + 63) / 64;
+
+	uint64_t w[words];
+
+	//word i of the set shifted towards higher bits by n, for 0 < n < 64
+	uint64_t up(int i, int n) const {
+		return (w[i] << n) | (i > 0 ? w[i-1] >> (64 - n) : 0);
+	}
+	//word i of the set shifted towards lower bits by n, for 0 < n < 64
+	uint64_t down(int i, int n) const {
+		return (w[i] >> n) | (i + 1 < words ? w[i+1] << (64 - n) : 0);
+	}
+
+public:
+	BitboardHex() { clear(); }
+
+	void clear() {
+		for(int i = 0; i < words; i++)
+			w[i] = 0;
+	}
+
+	bool get(int i)    const { return (w[i >> 6] >> (i & 63)) & 1; }
+	void set(int i)          { w[i >> 6] |=  (uint64_t)1 << (i & 63); }
+	void unset(int i)        { w[i >> 6] &= ~((uint64_t)1 << (i & 63)); }
+
+	bool empty() const {
+		uint64_t any = 0;
+		for(int i = 0; i < words; i++)
+			any |= w[i];
+		return !any;
+	}
+
+	bool intersects(const BitboardHex & o) const {
+		uint64_t any = 0;
+		for(int i = 0; i < words; i++)
+			any |= w[i] & o.w[i];
+		return any;
+	}
+
+	BitboardHex operator & (const BitboardHex & o) const {
+		BitboardHex r;
+		for(int i = 0; i < words; i++)
+			r.w[i] = w[i] & o.w[i];
+		return r;
+	}
+
+	bool operator == (const BitboardHex & o) const {
+		uint64_t diff = 0;
+		for(int i = 0; i < words; i++)
+			diff |= w[i] ^ o.w[i];
+		return !diff;
+	}
+	bool operator != (const BitboardHex & o) const { return !(*this == o); }
+
+	//the cells of a size x size grid where f(x, y) is true
+	template<class F>
+	static BitboardHex cells(int size, F f) {
+		BitboardHex r;
+		for(int y = 0; y < size; y++)
+			for(int x = 0; x < size; x++)
+				if(f(x, y))
+					r.set(y*size + x);
+		return r;
+	}
+
+	//add all the cells one step away from this set and in within. notleft and notright are the cells that aren't in
+	//the first or last column, which stop steps along the rows from wrapping onto the next row
+	BitboardHex grow(int size, const BitboardHex & within, const BitboardHex & notleft, const BitboardHex & notright) const {
+		BitboardHex r;
+		for(int i = 0; i < words; i++){
+			uint64_t left  = down(i, 1) | up(i, size - 1);    //x-1,y and x-1,y+1
+			uint64_t right = up(i, 1)   | down(i, size - 1);  //x+1,y and x+1,y-1
+			uint64_t same  = w[i] | up(i, size) | down(i, size); //x,y+1 and x,y-1
+			r.w[i] = (same | (left & notright.w[i]) | (right & notleft.w[i])) & within.w[i];
+		}
+		return r;
+	}
+
+	//all the cells in within connected to this set through cells in within
+	BitboardHex flood(int size, const BitboardHex & within, const BitboardHex & notleft, const BitboardHex & notright) const {
+		BitboardHex cur = *this & within, next;
+		while((next = cur.grow(size, within, notleft, notright)) != cur)
+			cur = next;
+		return cur;
+	}
+};
+
+}; // namespace Morat
@@ -32,6 +32,17 @@ protected:
 		}
 	}
 
+	//undo update_pattern, the neighbors had nothing there before the move
+	void clear_pattern(const MoveValid& pos) {
+		Pattern p = 3;
+		for (auto m : self()->neighbors_large(pos)) {
+			if(m.on_board()){
+				self()->cells_[m.xy].pattern &= ~p;
+			}
+			p <<= 2;
+		}
+	}
+
 	Pattern init_pattern(const MoveValid& pos) {
 		Pattern p = 0, j = 3;
 		for (const MoveValid m : self()->neighbors_large(pos)) {
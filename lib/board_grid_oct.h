@@ -14,7 +14,7 @@ class BoardGridOct : public BoardBase<SubClassBoard> {
 public:
 	const MoveValid* neighbors(const Move& m)      const { return neighbors(self()->xy(m)); }
 	const MoveValid* neighbors(const MoveValid& m) const { return neighbors(m.xy); }
-	const MoveValid* neighbors(int i) const { return self()->neighbor_list_.get() + i*24; }
+	const MoveValid* neighbors(int i) const { return self()->neighbor_list_ + i*24; }
 
 	NeighborIterator neighbors_small(const Move& m)      const { return neighbors_small(self()->xy(m)); }
 	NeighborIterator neighbors_small(const MoveValid& m) const { return neighbors_small(m.xy); }
@@ -0,0 +1,67 @@
+#pragma once
+
+//Lets a board take back moves without copying the whole board for each one. While a journal is set the board saves
+//its header (all the members before the cells) when a move starts, and each cell just before changing it. Undo puts
+//them back in the reverse order, so a cell changed several times ends up as it was before the move.
+
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+namespace Morat {
+
+template<class Cell>
+class BoardJournal {
+	struct Change {
+		unsigned int xy;
+		Cell cell;
+	};
+	struct Mark {
+		size_t changes;
+		size_t header;
+	};
+
+	std::vector<Change> changes;
+	std::vector<char>   headers;
+	std::vector<Mark>   marks;
+
+public:
+	//how many moves can be undone
+	size_t depth() const { return marks.size(); }
+
+	void clear() {
+		changes.clear();
+		headers.clear();
+		marks.clear();
+	}
+
+	//start a move, saving the first header_size bytes of the board
+	void begin(const void * board, size_t header_size) {
+		marks.push_back(Mark{changes.size(), headers.size()});
+		const char * h = (const char *)board;
+		headers.insert(headers.end(), h, h + header_size);
+	}
+
+	//save a cell before it is changed
+	void save(unsigned int xy, const Cell & cell) {
+		assert(!marks.empty());
+		changes.push_back(Change{xy, cell});
+	}
+
+	//restore the cells and header saved since the last begin
+	void undo(void * board, Cell * cells) {
+		assert(!marks.empty());
+		Mark m = marks.back();
+		marks.pop_back();
+
+		while(changes.size() > m.changes){
+			cells[changes.back().xy] = changes.back().cell;
+			changes.pop_back();
+		}
+
+		memcpy(board, headers.data() + m.header, headers.size() - m.header);
+		headers.resize(m.header);
+	}
+};
+
+}; // namespace Morat
@@ -1,12 +1,23 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
+#include <cstdio>
 #include <cstring> //for memmove
+#include <deque>
+#include <fcntl.h>
 #include <new>
 #include <stdint.h>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
 
+#include "depthstats.h"
 #include "thread.h"
+#include "time.h"
 
 namespace Morat {
 
@@ -17,10 +28,86 @@ namespace Morat {
  * compacting the empty space and freeing it back to the OS. It can scan memory since it is a contiguous block
  * of memory with no fragmentation.
  * Your tree Node should include an instance of CompactTree<Node>::Children named 'children'
+ *
+ * Threads that allocate heavily should each own an Arena, which hands out memory from a private slab of a chunk
+ * and keeps its own freelist, only falling back to the shared freelist and chunk list when those run dry.
+ *
+ * Chunks are mmap'd straight from the OS, optionally backed by huge pages to cut down on TLB misses while walking
+ * the tree, and memory freed by compacting is given back to the OS right away.
+ *
+ * Compaction can be done all at once with compact, or a few chunks at a time with compact_start and compact_step,
+ * letting the other threads keep searching in between the steps.
+ *
+ * Subtrees that are cut out of the tree can be handed to a Disposer to be freed a few blocks at a time.
+ *
+ * A tree can be saved to a file laid out like the chunks, which load reads straight back in as chunks.
  */
+//The start of a file written by CompactTree::save. It's followed by the root node, then the caller's info, then the
+//chunks, starting at the first page boundary after that
+struct CompactTreeHeader {
+	char     magic[8];   //"MoratCT" and the version
+	uint32_t nodesize;   //sizeof(Node), files only load into a build with the same Node
+	uint32_t refsize;    //size of a child reference, which depends on COMPACTTREE_HANDLES
+	uint32_t chunksize;  //size of each chunk in the file
+	uint32_t numchunks;
+	uint32_t lastused;   //bytes used in the last chunk, the others are full
+	uint32_t infolen;    //length of the info string
+	uint64_t dataoff;    //file offset of the first chunk
+	uint64_t nodes;      //nodes in the tree, not counting the root
+	uint64_t rootref;    //file offset of the root's children in 8 byte words, 0 for none
+
+	static const char * MAGIC() { return "MoratCT1"; }
+
+	bool valid() const { return memcmp(magic, MAGIC(), sizeof(magic)) == 0; }
+
+	//read the header and the info string of a saved tree, returns false if it isn't one
+	static bool read(const std::string & filename, CompactTreeHeader & h, std::string & info){
+		int fd = open(filename.c_str(), O_RDONLY);
+		if(fd < 0)
+			return false;
+		bool ok = (pread(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h) && h.valid());
+		if(ok){
+			info.resize(h.infolen);
+			ok = (h.infolen == 0 || pread(fd, &info[0], h.infolen, sizeof(h) + h.nodesize) == (ssize_t)h.infolen);
+		}
+		close(fd);
+		return ok;
+	}
+	static bool read_info(const std::string & filename, std::string & info){
+		CompactTreeHeader h;
+		return read(filename, h, info);
+	}
+};
+
 template <class Node> class CompactTree {
-	static const unsigned int CHUNK_SIZE = 16*1024*1024;
+	static const unsigned int CHUNK_SIZE = 16*1024*1024; //default size of a chunk
+	static const unsigned int MIN_CHUNK_SIZE = 1024*1024;
+	static const unsigned int MAX_CHUNK_SIZE = 1024*1024*1024;
+	static const unsigned int HUGE_PAGE_SIZE = 2*1024*1024;
 	static const unsigned int MAX_NUM = 25*25 + 1; //maximum amount of Node's to allocate at once, needed for size of freelist
+	static const unsigned int SLAB_SIZE = 256*1024; //how much memory an Arena takes from a chunk at a time
+	static const unsigned int ARENA_FREE = 32; //how many free Data blocks of each size an Arena keeps before sharing them
+
+	struct Data;
+
+#ifdef COMPACTTREE_HANDLES
+	//Children reference their Data with a 32bit handle instead of a pointer, which shrinks every Node by 4 bytes.
+	//A handle is the offset in 8 byte words from the start of a 32gb range of address space that is reserved up front,
+	//and that all the chunks of all the trees of this Node type are placed in. The first huge page is never used, so
+	//handles 0 and 1 are free to mean NULL and locked.
+	typedef uint32_t Ref;
+	static const uint64_t SPACE_SIZE = ((uint64_t)1 << 32) * sizeof(uint64_t);
+	static char * space;
+	static uint8_t spaceused[SPACE_SIZE / HUGE_PAGE_SIZE]; //which huge page sized pieces of the space are in use
+	static SpinLock spacelock;
+
+	static Data * deref(Ref r)   { return (Data *)(space + ((uint64_t)r << 3)); }
+	static Ref    ref(Data * d)  { return (Ref)(((char *)d - space) >> 3); }
+#else
+	typedef Data * Ref;
+	static Data * deref(Ref r)   { return r; }
+	static Ref    ref(Data * d)  { return d; }
+#endif
 
 	//Hold a list of children within the compact tree
 	struct Data {
@@ -31,8 +118,9 @@ template <class Node> class CompactTree {
 		//sizes are chosen such that they add to a multiple of word size on 32bit and 64bit machines.
 
 		union {
-			Data ** parent;  //pointer to the Data* in the parent Node that references this Data instance
-			Data *  nextfree; //next free Data block of this size when in the free list
+			Ref *  parent;   //pointer to the reference in the parent Node to this Data instance, a real pointer since
+			                 //the parent may live outside the tree, like the root or a temporary being filled in
+			Data * nextfree; //next free Data block of this size when in the free list
 		};
 
 		// array of Nodes, runs past the end of the data block. Should be size [0] or even []
@@ -40,9 +128,8 @@ template <class Node> class CompactTree {
 		// 1 member, allocate enough for the full capacity, and run off the end of the array.
 		Node        children[1];
 
-		Data(unsigned int n, Data ** p) : capacity(n), used(n), parent(p) {
-			header = (((unsigned long)this >> 2) & 0xFFFF) | (0xBEEF << 16);
-			if(empty()) header += 0xABCD;
+		Data(unsigned int c, unsigned int n, Ref * p) : capacity(c), used(n), parent(p) {
+			set_header();
 
 			for(Node * i = begin(), * e = end(); i != e; ++i)
 				new(i) Node(); //call the constructors
@@ -54,13 +141,37 @@ template <class Node> class CompactTree {
 			header = 0;
 		}
 
-		//how big is this structure in bytes by capacity or used
-		size_t mem_size() const { return sizeof(Data) + sizeof(Node)*capacity; }
-		size_t memused() const { return sizeof(Data) + sizeof(Node)*used; }
+		//the sanity check value depends on where the block is, so it needs setting again after a load
+		void set_header(){
+			header = (((unsigned long)this >> 2) & 0xFFFF) | (0xBEEF << 16);
+			if(empty()) header += 0xABCD;
+		}
+
+		//how big is this structure in bytes by capacity or used, rounded so the next one stays aligned
+		static size_t size(unsigned int n) { return (sizeof(Data) - sizeof(Node) + sizeof(Node)*n + 7) & ~(size_t)7; }
+		size_t mem_size() const { return size(capacity); }
+		size_t memused() const { return size(used); }
 
 		bool empty() const { return (header <= oldcount); }
 		bool old()   const { return (header == oldcount); }
 
+		//a filler covers memory an Arena reserved but never used, it is skipped by compact and never reused directly
+		//it only needs the first word of the header, so it can cover any multiple of 8 bytes
+		bool filler() const { return (capacity == 0); }
+		size_t filler_size() const { return sizeof(uint64_t)*used; }
+		static void fill(char * mem, size_t size){
+			assert(size % sizeof(uint64_t) == 0);
+			while(size > 0){
+				size_t s = std::min(size, (size_t)sizeof(uint64_t)*0xFFFF);
+				Data * d = (Data *)mem;
+				d->header = 0;
+				d->capacity = 0;
+				d->used = s / sizeof(uint64_t);
+				mem += s;
+				size -= s;
+			}
+		}
+
 		Node * begin(){
 			return children;
 		}
@@ -85,16 +196,16 @@ template <class Node> class CompactTree {
 
 		//make sure the parent points back to the same place
 		bool parent_consistent() const {
-			return (header == (*parent)->header);
+			return (header == deref(*parent)->header);
 		}
 
 		//called after moving the memory to update the parent pointers for this node and its children
 		void move(Data * s){
 			assert(!empty()); //don't move an empty Data segment
-			assert(*parent == s); //my parent points to my old location
+			assert(deref(*parent) == s); //my parent points to my old location
 
 			//update my parent with my new location
-			*parent = this;
+			*parent = ref(this);
 
 			//make sure the parent points back to the same place
 			assert(parent_consistent());
@@ -102,68 +213,86 @@ template <class Node> class CompactTree {
 			//update my children
 			for(Node * i = begin(), * e = end(); i != e; ++i){
 				if(i->children.data){
-					i->children.data->parent = &(i->children.data);
-					assert(i->children.data->parent_consistent());
+					deref(i->children.data)->parent = &(i->children.data);
+					assert(deref(i->children.data)->parent_consistent());
 				}
 			}
 		}
 	};
 
 public:
+	class Arena;
+
 	//Sits in Node to manage the children, which are actually stored in a Data struct
 	class Children {
-		static const int LOCK = 1; //must be cast to (Data *) at usage point
-		Data * data;
+		static const int LOCK = 1; //must be cast to Ref at usage point
+		Ref data;
 		friend struct Data;
+		friend class CompactTree;
+
+		Data * get() const { return deref(data); }
 
 	public:
 		typedef Node * iterator;
-		Children() : data(NULL) { }
-		~Children() { assert(data == NULL); }
+		Children() : data(Ref(0)) { }
+		~Children() { assert(data == Ref(0)); }
 
 		//lock the children, so only one thread creates them at a time, returns false if another thread already has the lock
-		bool lock()   { return CAS(data, (Data *) NULL, (Data *) LOCK); }
-		bool unlock() { return CAS(data, (Data *) LOCK, (Data *) NULL); }
+		bool lock()   { return CAS(data, Ref(0), Ref(LOCK)); }
+		bool unlock() { return CAS(data, Ref(LOCK), Ref(0)); }
 
 		//allocate n nodes, likely best used in a temporary node and swapped in
 		unsigned int alloc(unsigned int n, CompactTree & ct){
-			assert(data == NULL);
-			data = ct.alloc(n, &data);
+			assert(data == Ref(0));
+			data = ref(ct.alloc(n, &data));
+			return n;
+		}
+		unsigned int alloc(unsigned int n, Arena & arena){
+			assert(data == Ref(0));
+			data = ref(arena.alloc(n, &data));
 			return n;
 		}
 
 		//deallocate the children
 		unsigned int dealloc(CompactTree & ct){
-			Data * t = data;
+			Ref t = data;
 			int n = 0;
-			if(t && CAS(data, t, (Data*)NULL)){
-				n = t->used;
-				ct.dealloc(t);
+			if(t && CAS(data, t, Ref(0))){
+				n = deref(t)->used;
+				ct.dealloc(deref(t));
+			}
+			return n;
+		}
+		unsigned int dealloc(Arena & arena){
+			Ref t = data;
+			int n = 0;
+			if(t && CAS(data, t, Ref(0))){
+				n = deref(t)->used;
+				arena.dealloc(deref(t));
 			}
 			return n;
 		}
 		//swap children with the other node, used for threadsafe child creation
 		void swap(Children & other){
 			//swap data pointer
-			Data * temp;
+			Ref temp;
 			temp = data;
 			data = other.data;
 			other.data = temp;
-			temp = NULL;
 
 			//update parent pointer
-			if(data > (Data*)LOCK)
-				data->parent = &data;
-			if(other.data > (Data*)LOCK)
-				other.data->parent = &(other.data);
+			if(data > Ref(LOCK))
+				get()->parent = &data;
+			if(other.data > Ref(LOCK))
+				other.get()->parent = &(other.data);
 		}
 		//keep only the first n children, used if too many children were allocated
 		int shrink(int n){
-			return data->shrink(n);
+			return get()->shrink(n);
 		}
 		//how many children are there?
 		unsigned int num() const {
-			return (data > (Data *) LOCK ? data->used : 0);
+			return (data > Ref(LOCK) ? get()->used : 0);
 		}
 		//does this node have any children?
 		bool empty() const {
@@ -171,20 +300,30 @@ public:
 		}
 		//access a child at a specific offset
 		Node & operator[](unsigned int offset){
-			assert(data > (Data *) LOCK);
-			assert(offset >= 0 && offset < data->used);
-			return data->children[offset];
+			assert(data > Ref(LOCK));
+			assert(offset >= 0 && offset < get()->used);
+			return get()->children[offset];
 		}
 		//iterator through the children
 		Node * begin() const {
-			if(data > (Data *) LOCK)
-				return data->begin();
+			if(data > Ref(LOCK))
+				return get()->begin();
 			return NULL;
 		}
 		//end of the iterator through the children
 		Node * end() const {
-			if(data > (Data *) LOCK)
-				return data->end();
+			if(data > Ref(LOCK))
+				return get()->end();
+			return NULL;
+		}
+		//begin and end from a single read of the children, for walking them while another thread may swap in a new set
+		Node * range(Node * & e) const {
+			Ref d = *(volatile Ref *)&data;
+			if(d > Ref(LOCK)){
+				e = deref(d)->end();
+				return deref(d)->begin();
+			}
+			e = NULL;
 			return NULL;
 		}
 	};
@@ -198,15 +337,15 @@ private:
 		uint32_t used;     //in bytes
 		char *   mem;  //actual memory
 
-		Chunk()               : next(NULL), id(0), capacity(0), used(0), mem(NULL) { }
-		Chunk(unsigned int c) : next(NULL), id(0), capacity(0), used(0), mem(NULL) { alloc(c); }
+		Chunk()                              : next(NULL), id(0), capacity(0), used(0), mem(NULL) { }
+		Chunk(unsigned int c, int hugepages) : next(NULL), id(0), capacity(0), used(0), mem(NULL) { alloc(c, hugepages); }
 		~Chunk() { assert_empty(); }
 
-		void alloc(unsigned int c){
+		void alloc(unsigned int c, int hugepages){
 			assert_empty();
 			capacity = c;
 			used = 0;
-			mem = (char*) new uint64_t[capacity / sizeof(uint64_t)]; //use uint64_t instead of char to guarantee alignment
+			mem = map(capacity, hugepages);
 		}
 		void dealloc(bool deallocnext = false){
 			assert(capacity > 0 && mem != NULL);
@@ -216,18 +355,139 @@ private:
 				next = NULL;
 			}
 			assert(next == NULL);
+			unmap(mem, capacity);
 			capacity = 0;
 			used = 0;
-			delete[] (uint64_t *)mem;
 			mem = NULL;
 		}
+		//read u bytes of a file saved by CompactTree::save into a new chunk of capacity c
+		bool read_file(int fd, uint64_t offset, unsigned int c, unsigned int u, int hugepages){
+			alloc(c, hugepages);
+			used = u;
+			for(unsigned int done = 0; done < u; ){
+				ssize_t r = pread(fd, mem + done, u - done, offset + done);
+				if(r <= 0)
+					return false;
+				done += r;
+			}
+			return true;
+		}
 		void assert_empty(){ assert(capacity == 0 && used == 0 && mem == NULL && next == NULL); }
+		//zero the unused part, giving whole pages back to the OS instead of writing to them
 		void clear_unused(){
-			for(char * i = mem + used, * iend = mem + capacity ; i != iend; i++)
-				*i = 0;
+			static const uintptr_t pagesize = sysconf(_SC_PAGESIZE);
+			char * end = mem + capacity,
+			     * page = std::min(end, (char *)(((uintptr_t)(mem + used) + pagesize - 1) & ~(pagesize - 1)));
+			if(page == end || madvise(page, end - page, MADV_DONTNEED) != 0) //explicit huge pages may refuse
+				page = end;
+			memset(mem + used, 0, page - (mem + used));
+		}
+
+		//get memory from the OS. hugepages: 0 for normal pages, 1 for transparent huge pages, 2 for explicit huge pages,
+		//which need to be reserved ahead of time in /proc/sys/vm/nr_hugepages, falling back to transparent ones
+#ifdef COMPACTTREE_HANDLES
+		//the memory goes in a piece of the reserved address space, which is already aligned for huge pages
+		static char * map(size_t size, int hugepages){
+			char * mem = space_alloc(size);
+			void * m = MAP_FAILED;
+			int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
+#ifdef MAP_HUGETLB
+			if(hugepages == 2)
+				m = mmap(mem, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+			if(m != MAP_FAILED)
+				return mem;
+#endif
+			m = mmap(mem, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+			if(m == MAP_FAILED){
+				unmap(mem, size);
+				throw std::bad_alloc();
+			}
+#ifdef MADV_HUGEPAGE
+			if(hugepages > 0)
+				madvise(mem, size, MADV_HUGEPAGE);
+#endif
+			return mem;
+		}
+		//give the memory back to the OS, but keep the address space reserved
+		static void unmap(char * mem, size_t size){
+			mmap(mem, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+			space_free(mem, size);
+		}
+#else
+		static char * map(size_t size, int hugepages){
+			void * mem = MAP_FAILED;
+#ifdef MAP_HUGETLB
+			if(hugepages == 2)
+				mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if(mem != MAP_FAILED)
+				return (char *)mem;
+#endif
+			if(hugepages == 0){
+				mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if(mem == MAP_FAILED)
+					throw std::bad_alloc();
+				return (char *)mem;
+			}
+
+			//transparent huge pages only cover aligned huge pages, so map extra and trim it down to an aligned range
+			mem = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if(mem == MAP_FAILED)
+				throw std::bad_alloc();
+			char * start = (char *)mem,
+			     * aligned = (char *)(((uintptr_t)start + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+			if(aligned != start)
+				munmap(start, aligned - start);
+			if(aligned + size != start + size + HUGE_PAGE_SIZE)
+				munmap(aligned + size, start + size + HUGE_PAGE_SIZE - (aligned + size));
+#ifdef MADV_HUGEPAGE
+			madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+			return aligned;
+		}
+		static void unmap(char * mem, size_t size){
+			munmap(mem, size);
 		}
+#endif
 	};
 
+#ifdef COMPACTTREE_HANDLES
+	//find room for a chunk in the reserved address space, reserving the space the first time
+	static char * space_alloc(size_t size){
+		const size_t n = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE,
+		             slots = SPACE_SIZE / HUGE_PAGE_SIZE;
+
+		spacelock.lock();
+		if(space == NULL){
+			void * mem = mmap(NULL, SPACE_SIZE + HUGE_PAGE_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+			if(mem == MAP_FAILED){
+				spacelock.unlock();
+				throw std::bad_alloc();
+			}
+			space = (char *)(((uintptr_t)mem + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+			spaceused[0] = 1; //never used so no Data block has handle 0 or 1
+		}
+
+		size_t run = 0;
+		for(size_t i = 1; i < slots; i++){
+			run = (spaceused[i] ? 0 : run + 1);
+			if(run == n){
+				std::fill(spaceused + i + 1 - n, spaceused + i + 1, 1);
+				spacelock.unlock();
+				return space + (i + 1 - n) * HUGE_PAGE_SIZE;
+			}
+		}
+		spacelock.unlock();
+		throw std::bad_alloc();
+	}
+	static void space_free(char * mem, size_t size){
+		const size_t first = (mem - space) / HUGE_PAGE_SIZE,
+		             n = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE;
+		spacelock.lock();
+		std::fill(spaceused + first, spaceused + first + n, 0);
+		spacelock.unlock();
+	}
+#endif
+
 	class Freelist {
 		Data * list[MAX_NUM];
 		SpinLock lock;
@@ -240,6 +500,11 @@ private:
 				list[i] = NULL;
 		}
 
+		//racy check whether there is anything of this size, used to avoid taking the lock for nothing
+		bool has(unsigned int num) const {
+			return (list[num] != NULL);
+		}
+
 		void push_nolock(Data * d){
 			unsigned int num = d->capacity;
 			d->nextfree = list[num];
@@ -251,6 +516,14 @@ private:
 			push_nolock(d);
 			lock.unlock();
 		}
+		//push a linked list of Data blocks of the same size, from first to last
+		void push(Data * first, Data * last){
+			unsigned int num = first->capacity;
+			lock.lock();
+			last->nextfree = list[num];
+			list[num] = first;
+			lock.unlock();
+		}
 
 		Data * pop_nolock(unsigned int num){
 			Data * t = list[num];
@@ -266,6 +539,197 @@ private:
 		}
 	};
 
+public:
+	//Thread local allocation state. Allocates from a private slab of a chunk and keeps a private freelist, so the
+	//common case touches no shared cache lines. Falls back to the shared freelist when its own is empty, and
+	//gives its free blocks back to the shared freelist when it has too many of one size.
+	//Only one thread may use an Arena at a time, but it may free memory allocated by any Arena.
+	class Arena {
+		friend class CompactTree;
+
+		CompactTree * ct;
+		Arena * next;     //linked list of all arenas of this tree
+		char * mem,       //where to allocate next in the slab
+		     * memend;    //end of the slab
+		int64_t memused;  //change in memory in use since the last compact, can be negative
+		Data * list[MAX_NUM];
+		uint16_t count[MAX_NUM];
+
+		//give the unused part of the slab back as filler so the chunk can still be scanned
+		void release_slab(){
+			if(mem != memend)
+				Data::fill(mem, memend - mem);
+			mem = memend = NULL;
+		}
+
+		//forget everything that was local, called by compact, which rebuilds the freelists itself
+		void reset(){
+			release_slab();
+			for(unsigned int i = 0; i < MAX_NUM; i++){
+				list[i] = NULL;
+				count[i] = 0;
+			}
+			ct->memused += memused;
+			memused = 0;
+		}
+
+		//give the local free blocks back to the shared freelist
+		void flush_freelist(){
+			for(unsigned int i = 0; i < MAX_NUM; i++)
+				flush_freelist(i);
+		}
+		void flush_freelist(unsigned int num){
+			Data * first = list[num];
+			if(!first)
+				return;
+			Data * last = first;
+			while(last->nextfree)
+				last = last->nextfree;
+			ct->freelist.push(first, last);
+			list[num] = NULL;
+			count[num] = 0;
+		}
+
+	public:
+		Arena(CompactTree & c) : ct(&c), next(NULL), mem(NULL), memend(NULL), memused(0) {
+			reset();
+			ct->add_arena(this);
+		}
+		~Arena(){
+			ct->remove_arena(this);
+			release_slab();
+			flush_freelist();
+			PLUS(ct->memused, memused);
+		}
+
+		Data * alloc(unsigned int num, Ref * parent){
+			assert(num > 0 && num < MAX_NUM);
+
+			unsigned int cap = ct->sizeclass[num];
+			unsigned int size = Data::size(cap);
+			memused += size;
+
+		//check the local freelist
+			if(Data * t = list[cap]){
+				list[cap] = t->nextfree;
+				count[cap]--;
+				assert(t->empty() && t->capacity == cap);
+				return new(t) Data(cap, num, parent);
+			}
+
+		//check the shared freelist
+			if(ct->freelist.has(cap)){
+				if(Data * t = ct->freelist.pop(cap)){
+					assert(t->empty() && t->capacity == cap);
+					return new(t) Data(cap, num, parent);
+				}
+			}
+
+		//allocate from the slab, getting a new one if needed
+			if(memend - mem < (ptrdiff_t)size){
+				release_slab();
+				unsigned int got;
+				mem = ct->reserve(size, SLAB_SIZE, got);
+				memend = mem + got;
+			}
+			Data * d = (Data *)mem;
+			mem += size;
+			return new(d) Data(cap, num, parent);
+		}
+
+		void dealloc(Data * d){
+			assert(!d->empty() && d->capacity > 0 && d->capacity < MAX_NUM);
+
+			unsigned int num = d->capacity;
+			memused -= d->mem_size();
+
+			//call the destructor, then mark it empty. The destructor clears the header too, but stores
+			//in a destructor are dead as far as the optimizer is concerned, so do it again here
+			d->~Data();
+			d->header = 0;
+			d->used = 0;
+
+			//nothing is reused during a compaction pass, it might be in a chunk that is about to be compacted
+			if(ct->inpass)
+				return;
+
+			//keep it locally unless there are already plenty of this size
+			if(count[num] >= ARENA_FREE)
+				flush_freelist(num);
+			d->nextfree = list[num];
+			list[num] = d;
+			count[num]++;
+		}
+	};
+
+	//Frees subtrees that were cut out of the tree a few blocks at a time, so dropping a big part of the tree, like the
+	//siblings of the move just played, doesn't stall whoever dropped it. The subtrees wait in a deque since its elements
+	//stay put, and each one is the parent of the Data it holds. Threads that are searching anyway take turns freeing a
+	//step at a time, and anything that needs the memory right away can free the rest all at once.
+	class Disposer {
+		std::deque<Node> queue; //freed from the back, so it only grows to about the depth times the width of the tree
+		SpinLock lock;
+		volatile bool pending;
+		uint64_t freed; //nodes freed since it was last empty
+		Time started;
+
+	public:
+		Disposer() : pending(false), freed(0) { }
+		~Disposer() { assert(queue.empty()); }
+
+		bool empty() const { return !pending; }
+		uint64_t num_freed() const { return freed; }
+		double time_taken() const { return Time() - started; }
+
+		//take over the children of n. Only while no other thread is using the disposer
+		void add(Node & n){
+			if(n.children.num() == 0)
+				return;
+			if(!pending){
+				freed = 0;
+				started = Time();
+			}
+			queue.emplace_back();
+			queue.back().children.swap(n.children);
+			pending = true;
+		}
+
+		//free up to blocks Data blocks with this Arena, returns the number of nodes freed
+		//only one thread does a step at a time, any others return 0 right away
+		unsigned int step(Arena & arena, unsigned int blocks){
+			if(!pending || !lock.trylock())
+				return 0;
+			unsigned int num = free(arena, blocks);
+			lock.unlock();
+			return num;
+		}
+
+		//free everything. Only while no other thread is using the disposer
+		unsigned int clear(CompactTree & ct){
+			return free(ct, 0);
+		}
+
+	private:
+		template <class Alloc> unsigned int free(Alloc & alloc, unsigned int blocks){
+			unsigned int num = 0;
+			for(unsigned int i = 0; !queue.empty() && (blocks == 0 || i < blocks); i++){
+				Node n;
+				n.children.swap(queue.back().children);
+				queue.pop_back();
+				for(Node * c = n.children.begin(), * e = n.children.end(); c != e; ++c){
+					if(c->children.num()){
+						queue.emplace_back();
+						queue.back().children.swap(c->children);
+					}
+				}
+				num += n.children.dealloc(alloc);
+			}
+			freed += num;
+			pending = !queue.empty();
+			return num;
+		}
+	};
+
 
 	Chunk * head,    //start of the chunk list
 	      * current, //where memory is currently being allocated
@@ -273,16 +737,103 @@ private:
 	unsigned int numchunks;
 	Freelist freelist;
 	uint64_t memused;
+	uint64_t chunkused; //sum of used over all chunks
+	unsigned int chunksize; //size of new chunks
+	int hugepages;          //what kind of pages to back new chunks with, see Chunk::map
+	bool sizeclasses;                //whether capacities are rounded up to geometric size classes
+	uint16_t sizeclass[MAX_NUM];     //capacity to allocate for a given number of children
+	Arena * arenas; //linked list of the arenas allocating from this tree
+	mutable SpinLock arenalock;
+
+	//state of a compaction pass, so it can be done a few chunks at a time
+	struct CompactPass {
+		Chunk      * schunk, * dchunk; //source and destination chunks
+		unsigned int soff, doff;       //source and destination offsets
+		Chunk      * end;              //last chunk to compact, anything after it was allocated during the pass
+		unsigned int endid;            //id of end when the pass started
+		unsigned int generationid;     //first chunk to compact, the ones before it only build the freelist
+		bool         compactthischunk;
+		bool         recount;          //recount memused, only possible if nothing else is allocating
+		float        arenasize;
+	} pass;
+	bool inpass;
+	Time nextstep;
+	DepthStats pauses;
+
+	void add_arena(Arena * a){
+		arenalock.lock();
+		a->next = arenas;
+		arenas = a;
+		arenalock.unlock();
+	}
+	void remove_arena(Arena * a){
+		arenalock.lock();
+		for(Arena ** i = &arenas; *i; i = &((*i)->next)){
+			if(*i == a){
+				*i = a->next;
+				break;
+			}
+		}
+		arenalock.unlock();
+	}
+
+	//reserve fresh memory from the chunks: at least size bytes, but up to want bytes if they're available in this chunk
+	//the amount actually reserved is returned in got
+	char * reserve(unsigned int size, unsigned int want, unsigned int & got){
+		while(1){
+			Chunk * c = current;
+			uint32_t used = c->used;
+			if(used + size <= c->capacity){ //if there is room, try to use it
+				got = std::min(want, c->capacity - used);
+				if(CAS(c->used, used, used+got)){
+					PLUS(chunkused, got);
+					return c->mem + used;
+				}else{
+					continue;
+				}
+			}else if(c->next != NULL){ //if there is a next chunk, advance to it and try again
+				CAS(current, c, c->next); //CAS to avoid skipping a chunk
+				CAS(last, c, c->next); //most last forward too
+				continue;
+			}else{ //need to allocate a new chunk
+				Chunk * next = new Chunk(chunksize, hugepages);
+
+				while(1){
+					while(c->next != NULL) //advance to the end
+						c = c->next;
+
+					next->id = c->id+1;
+					if(CAS(c->next, (Chunk *)NULL, next)){ //put it in place
+						INCR(numchunks);
+						//note that this doesn't move current forward since this may not be the next chunk
+						// if there is a race condition where two threads allocate chunks at the same time
+						break;
+					}
+				}
+				continue;
+			}
+		}
+		assert(false && "How'd CompactTree::reserve get here?");
+		return NULL;
+	}
 
 public:
 
 	CompactTree() {
+		chunksize = CHUNK_SIZE;
+		hugepages = 1;
+		set_size_classes(false);
+
 		//allocate the first chunk
-		head = current = last = new Chunk(CHUNK_SIZE);
+		head = current = last = new Chunk(chunksize, hugepages);
 		numchunks = 1;
 		memused = 0;
+		chunkused = 0;
+		arenas = NULL;
+		inpass = false;
 	}
 	~CompactTree(){
+		assert(arenas == NULL);
 		head->dealloc(true);
 		delete head;
 		head = current = last = NULL;
@@ -291,82 +842,172 @@ public:
 
 	//how much memory is malloced and available for use
 	uint64_t memarena() const {
-		Chunk * c = current;
-		while(c->next)
-			c = c->next;
-		return ((uint64_t)(c->id+1))*((uint64_t)CHUNK_SIZE);
+		uint64_t mem = 0;
+		for(Chunk * c = head; c; c = c->next)
+			mem += c->capacity;
+		return mem;
+	}
+
+	//size of the chunks requested from the OS, only affects new chunks. Rounded to a multiple of the huge page size
+	unsigned int chunk_size() const { return chunksize; }
+	void set_chunk_size(uint64_t size){
+		size = std::max<uint64_t>(MIN_CHUNK_SIZE, std::min<uint64_t>(MAX_CHUNK_SIZE, size));
+		chunksize = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+	}
+
+	//0 for normal pages, 1 for transparent huge pages, 2 for explicit huge pages, only affects new chunks
+	int huge_pages() const { return hugepages; }
+	void set_huge_pages(int h){
+		hugepages = std::max(0, std::min(2, h));
+	}
+
+	//round capacities up to geometric size classes about 12% apart, so a freed block can be reused by any request
+	//in its class instead of waiting for one of exactly its size, which gets rare as the board fills up.
+	//Costs up to 12% slack per block, which compact gives back as the number of children shrinks
+	//blocks that are already allocated keep their capacity, so it can be changed at any time
+	bool size_classes() const { return sizeclasses; }
+	void set_size_classes(bool s){
+		sizeclasses = s;
+		unsigned int cap = 0;
+		for(unsigned int n = 0; n < MAX_NUM; n++){
+			if(n > cap)
+				cap = std::min<unsigned int>(MAX_NUM - 1, (s ? std::max(n, cap + cap/8) : n));
+			sizeclass[n] = cap;
+		}
+	}
+
+	//breakdown of where the memory in the chunks is going, in bytes
+	struct MemStats {
+		uint64_t chunks, mapped, reserved; //memory requested from the OS, and how much of it was handed out
+		uint64_t blocks, nodes, live;      //blocks in the tree, the nodes they hold, and the memory they need at their size
+		uint64_t slack;                    //capacity beyond what is used: size classes and shrunk blocks not yet compacted
+		uint64_t freeblocks, freemem;      //blocks that were freed, either in a freelist or waiting for compact
+		uint64_t oldblocks, oldmem;        //the subset of those that have been empty for a few generations
+		uint64_t filler;                   //unused ends of arena slabs
+
+		MemStats() : chunks(0), mapped(0), reserved(0), blocks(0), nodes(0), live(0), slack(0),
+		             freeblocks(0), freemem(0), oldblocks(0), oldmem(0), filler(0) { }
+
+		std::string to_s() const {
+			std::string s;
+			s += "Chunks: " + to_str(chunks) + ", " + to_str(mapped/(1024*1024)) + " Mb mapped, " + to_str(reserved/(1024*1024)) + " Mb reserved\n";
+			s += "Live:   " + to_str(blocks) + " blocks, " + to_str(nodes) + " nodes, " + to_str(live/(1024*1024)) + " Mb + " + to_str(slack/(1024*1024)) + " Mb slack\n";
+			s += "Free:   " + to_str(freeblocks) + " blocks, " + to_str(freemem/(1024*1024)) + " Mb, of which " + to_str(oldblocks) + " blocks, " + to_str(oldmem/(1024*1024)) + " Mb are old\n";
+			s += "Filler: " + to_str(filler/(1024*1024)) + " Mb\n";
+			s += "Efficiency: " + to_str(100.0*live/std::max<uint64_t>(reserved, 1), 1) + "% of reserved, " + to_str(100.0*live/std::max<uint64_t>(mapped, 1), 1) + "% of mapped";
+			return s;
+		}
+	};
+
+	//walk all the chunks and classify every block, finishes any compaction pass in progress since that leaves gaps
+	//assume this is the only thread running, the arenas give up their slabs so they can be walked
+	MemStats mem_stats(){
+		if(inpass)
+			compact_step(0);
+
+		arenalock.lock();
+		for(Arena * a = arenas; a; a = a->next)
+			a->release_slab();
+		arenalock.unlock();
+
+		MemStats stats;
+		for(Chunk * c = head; c; c = c->next){
+			stats.chunks++;
+			stats.mapped += c->capacity;
+			stats.reserved += c->used;
+
+			for(unsigned int off = 0; off < c->used; ){
+				Data * d = (Data *)(c->mem + off);
+				if(d->filler()){
+					stats.filler += d->filler_size();
+					off += d->filler_size();
+					continue;
+				}
+				if(d->empty()){
+					stats.freeblocks++;
+					stats.freemem += d->mem_size();
+					if(d->old()){
+						stats.oldblocks++;
+						stats.oldmem += d->mem_size();
+					}
+				}else{
+					stats.blocks++;
+					stats.nodes += d->used;
+					stats.live += d->memused();
+					stats.slack += d->mem_size() - d->memused();
+				}
+				off += d->mem_size();
+			}
+		}
+		return stats;
 	}
 
 	//how much memory is in use or in a freelist, a good approximation of real memory usage from the OS perspective
 	uint64_t memalloced() const {
-		return ((uint64_t)(last->id))*((uint64_t)CHUNK_SIZE) + current->used;
+		return chunkused;
 	}
 
 	//how much memory is actually in use by nodes in the tree, plus the overhead of the Data struct
 	//uses capacity, so may be inacurate for data segments that were shrunk but haven't been compacted yet
 	//Data segments that are in the freelist are not included here
+	//includes the usage of all the arenas, so may be slightly off while they're allocating
 	uint64_t meminuse() const {
-		return memused;
+		arenalock.lock();
+		int64_t mem = memused;
+		for(Arena * a = arenas; a; a = a->next)
+			mem += a->memused;
+		arenalock.unlock();
+		return mem;
 	}
 
-	Data * alloc(unsigned int num, Data ** parent){
+	Data * alloc(unsigned int num, Ref * parent){
 		assert(num > 0 && num < MAX_NUM);
 
-		unsigned int size = sizeof(Data) + sizeof(Node)*num;
+		unsigned int cap = sizeclass[num];
+		unsigned int size = Data::size(cap);
 		PLUS(memused, size);
 
 	//check freelist
-		if(Data * t = freelist.pop(num)){
-			assert(t->empty() && t->capacity == num);
-			return new(t) Data(num, parent);
+		if(Data * t = freelist.pop(cap)){
+			assert(t->empty() && t->capacity == cap);
+			return new(t) Data(cap, num, parent);
 		}
 
 	//allocate new memory
-		while(1){
-			Chunk * c = current;
-			uint32_t used = c->used;
-			if(used + size <= c->capacity){ //if there is room, try to use it
-				if(CAS(c->used, used, used+size))
-					return new((Data *)(c->mem + used)) Data(num, parent);
-				else
-					continue;
-			}else if(c->next != NULL){ //if there is a next chunk, advance to it and try again
-				CAS(current, c, c->next); //CAS to avoid skipping a chunk
-				CAS(last, c, c->next); //most last forward too
-				continue;
-			}else{ //need to allocate a new chunk
-				Chunk * next = new Chunk(CHUNK_SIZE);
-
-				while(1){
-					while(c->next != NULL) //advance to the end
-						c = c->next;
-
-					next->id = c->id+1;
-					if(CAS(c->next, (Chunk *)NULL, next)){ //put it in place
-						INCR(numchunks);
-						//note that this doesn't move current forward since this may not be the next chunk
-						// if there is a race condition where two threads allocate chunks at the same time
-						break;
-					}
-				}
-				continue;
-			}
-		}
-		assert(false && "How'd CompactTree::alloc get here?");
-		return NULL;
+		unsigned int got;
+		return new((Data *)reserve(size, size, got)) Data(cap, num, parent);
 	}
 	void dealloc(Data * d){
 		assert(!d->empty() && d->capacity > 0 && d->capacity < MAX_NUM);
 
 		unsigned int size = d->mem_size();
-		PLUS(memused, -size);
+		PLUS(memused, -(int64_t)size);
 
-		//call the destructor
+		//call the destructor, then mark it empty. The destructor clears the header too, but stores
+		//in a destructor are dead as far as the optimizer is concerned, so do it again here
 		d->~Data();
+		d->header = 0;
 		d->used = 0;
 
-		//add to the freelist
-		freelist.push(d);
+		//add to the freelist, unless it might be in a chunk that is about to be compacted
+		if(!inpass)
+			freelist.push(d);
+	}
+
+	//is a compaction pass in progress?
+	bool compacting() const {
+		return inpass;
+	}
+
+	//is it time for the next step of an incremental compaction pass?
+	//steps are spaced out so the threads get at least as much time to search as the compaction takes
+	bool compact_due() const {
+		return (inpass && Time() >= nextstep);
+	}
+
+	//how long each step of the current or last compaction pass took, in usec
+	const DepthStats & compact_pauses() const {
+		return pauses;
 	}
 
 	//assume this is the only thread running
@@ -375,35 +1016,114 @@ public:
 	//generationsize is how far to go through the list only adding to the freelist, not compacting. This avoids moving memory
 	//  at the potential cost of not freeing any space at the end. Values around 1.0 are a waste of time, but 0.2 - 0.6 is good
 	void compact(float arenasize = 0, float generationsize = 0){
+		if(inpass) //finish off an incremental pass first
+			compact_step(0);
+		compact_start(arenasize, generationsize, false);
+		compact_step(0);
+	}
+
+	//start a compaction pass, which is then done by calling compact_step until it returns true.
+	//No other thread may be running during compact_start or compact_step, but if incremental is set, other threads may
+	//allocate and deallocate in between the steps. New memory then comes from chunks after the ones being compacted, and
+	//freed memory isn't reused until the pass is done. Without incremental, nothing may allocate until the pass is done.
+	void compact_start(float arenasize, float generationsize, bool incremental){
+		assert(!inpass);
 		assert(arenasize >= 0 && arenasize <= 1);
 		assert(generationsize >= 0 && generationsize <= 1);
 
-		memused = 0;
+		pauses.reset();
 
-		if(head->used == 0)
-			return;
+		//the arenas' slabs and freelists are rebuilt along with the shared ones
+		for(Arena * a = arenas; a; a = a->next)
+			a->reset();
+
+		if(!incremental) //nothing else is allocating, so recount it from scratch
+			memused = 0;
 
 		//clear the freelist
 		freelist.clear();
 
-		Chunk      * schunk = head; //source chunk
-		unsigned int soff   = 0;    //source offset
-		Chunk      * dchunk = schunk; //destination chunk
-		unsigned int doff   = soff;   //destination offset
+		//find the last chunk in use, anything after it is free
+		Chunk * end = NULL;
+		for(Chunk * c = head; c; c = c->next)
+			if(c->used > 0)
+				end = c;
 
-		unsigned int generationid = (unsigned int)(generationsize * current->id);
-		bool compactthischunk = (generationid == 0);
+		if(end == NULL)
+			return;
+
+		pass.schunk = pass.dchunk = head;
+		pass.soff = pass.doff = 0;
+		pass.end = end;
+		pass.endid = end->id;
+		pass.generationid = (unsigned int)(generationsize * end->id);
+		pass.compactthischunk = (pass.generationid == 0);
+		pass.recount = !incremental;
+		pass.arenasize = arenasize;
+
+		if(incremental){
+			//allocate after the chunks being compacted so the pass only ever sees them shrink
+			if(end->next == NULL){
+				Chunk * c = new Chunk(chunksize, hugepages);
+				c->id = end->id + 1;
+				end->next = c;
+				numchunks++;
+			}
+			current = last = end->next;
+		}
+
+		inpass = true;
+	}
+
+	//compact up to maxchunks more chunks, or all the rest if maxchunks is 0. Returns true once the pass is done
+	bool compact_step(unsigned int maxchunks){
+		if(!inpass) //compact_start found nothing to do
+			return true;
+
+		Time start;
+
+		Chunk      * schunk = pass.schunk; //source chunk
+		unsigned int soff   = pass.soff;   //source offset
+		Chunk      * dchunk = pass.dchunk; //destination chunk
+		unsigned int doff   = pass.doff;   //destination offset
+		bool compactthischunk = pass.compactthischunk;
+		const unsigned int generationid = pass.generationid;
+		unsigned int chunks = 0;
 
 		//iterate over each chunk, moving data blocks to the left to fill empty space
 		while(schunk != NULL){
+			if(soff >= schunk->used){ //done this chunk, move forward
+				//if the last chunk was being compacted out of order, finish it off
+				if(schunk->id < generationid && compactthischunk){
+					dchunk->used = doff;
+					dchunk->clear_unused();
+				}
+				//go to the next source chunk, unless this was the last one in the pass
+				schunk = (schunk == pass.end ? NULL : schunk->next);
+				soff = 0;
+				//if we're done the static generation, initialize the destination chunk
+				if(schunk){
+					if(schunk->id == generationid){
+						dchunk = schunk;
+						doff = soff;
+					}
+					compactthischunk = (schunk->id >= generationid);
+				}
+				if(++chunks == maxchunks)
+					break;
+				continue;
+			}
+
 			//iterate over each Data block
 			Data * s = (Data *)(schunk->mem + soff);
-			assert(s->capacity > 0 && s->capacity < MAX_NUM);
+			assert(s->capacity < MAX_NUM);
 
-			int ssize = s->mem_size(); //how much to move the source pointer
+			int ssize = (s->filler() ? s->filler_size() : s->mem_size()); //how much to move the source pointer
 
 			//move from -> to, update parent pointer
-			if(s->empty()){
+			if(s->filler()){
+				//unused memory, either skipped over or overwritten by the next full block
+			}else if(s->empty()){
 				if(!compactthischunk){
 					if(s->old()){//this empty segment is an unpopular size, lets compact this chunk to clean up this segment
 						compactthischunk = true;
@@ -416,15 +1136,17 @@ public:
 				}//else this position will be overwritten by the next full chunk
 			}else{
 				if(!compactthischunk){
-					memused += ssize;
+					if(pass.recount)
+						memused += ssize;
 				}else{
 					assert(s->used > 0 && s->used <= s->capacity);
-					int dsize = s->memused(); //how much to move the dest pointer
+					unsigned int dcap = std::min<unsigned int>(sizeclass[s->used], s->capacity); //shrink to the smallest class that fits
+					int dsize = Data::size(dcap); //how much to move the dest pointer
 					Data * d = NULL;
 
 					//where to move
 					while(1){
-						if((d = freelist.pop_nolock(s->used))){ //allocate off the freelist if possible
+						if((d = freelist.pop_nolock(dcap))){ //allocate off the freelist if possible
 							break;
 						}else if(doff + dsize <= dchunk->capacity){ //if space, allocate from this chunk
 							assert(schunk->id > dchunk->id || (schunk == dchunk && soff >= doff)); //make sure I'm moving left
@@ -441,47 +1163,290 @@ public:
 					}
 
 					//move!
-					s->capacity = s->used;
+					s->capacity = dcap;
 					if(s != d){
-						memmove(reinterpret_cast<void*>(d), reinterpret_cast<void*>(s), dsize);
+						memmove(reinterpret_cast<void*>(d), reinterpret_cast<void*>(s), s->memused());
 						d->move(s);
 					}
-					memused += dsize;
+					if(pass.recount)
+						memused += dsize;
+					else
+						memused -= ssize - dsize; //it was counted by capacity, which may have shrunk
 				}
 			}
 
 			//update source
 			soff += ssize;
-			while(schunk && schunk->used <= soff){ //move forward, skip empty chunks
-				//if the last chunk was being compacted out of order, finish it off
-				if(schunk->id < generationid && compactthischunk){
-					dchunk->used = doff;
-					dchunk->clear_unused();
+		}
+
+		pass.schunk = schunk;
+		pass.soff = soff;
+		pass.dchunk = dchunk;
+		pass.doff = doff;
+		pass.compactthischunk = compactthischunk;
+
+		if(schunk == NULL)
+			compact_finish();
+
+		double len = Time() - start;
+		pauses.add((unsigned int)(len*1000000));
+		nextstep = Time() + len;
+
+		return !inpass;
+	}
+
+	//Save the tree under root to a file, along with root itself and an info string for the caller. The file holds the
+	//blocks laid out in chunks just like in memory, with the references to children replaced by file offsets, so load
+	//only needs to read the chunks in and point the blocks at each other. Children are written before their parents so
+	//their offsets are known when the parent is written. Returns false if the file exists or can't be written.
+	//No other thread may change the tree while it's saved
+	bool save(const std::string & filename, const Node & root, const std::string & info) const {
+		int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if(fd < 0)
+			return false;
+
+		const uint64_t pagesize = sysconf(_SC_PAGESIZE);
+		CompactTreeHeader h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, CompactTreeHeader::MAGIC(), sizeof(h.magic));
+		h.nodesize = sizeof(Node);
+		h.refsize = sizeof(Ref);
+		h.chunksize = chunksize;
+		h.infolen = info.size();
+		h.dataoff = (sizeof(h) + sizeof(Node) + info.size() + pagesize - 1) / pagesize * pagesize;
+
+		Saver saver(fd, h.dataoff, chunksize);
+		Ref r = root.children.data;
+		h.rootref = (r > Ref(Children::LOCK) && deref(r)->used > 0 ? saver.write(deref(r)) : 0);
+		saver.write_chunk(); //the last chunk, possibly empty
+		h.numchunks = saver.chunks + 1;
+		h.lastused = saver.off;
+		h.nodes = saver.nodes;
+
+		//the root with its children pointing into the file, then the header and info in front of it
+		char rootbuf[sizeof(Node)];
+		memcpy(rootbuf, (const void *)&root, sizeof(Node));
+		((Node *)rootbuf)->children.data = file_ref(h.rootref);
+		bool ok = saver.ok &&
+			pwrite(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h) &&
+			pwrite(fd, rootbuf, sizeof(Node), sizeof(h)) == (ssize_t)sizeof(Node) &&
+			pwrite(fd, info.data(), info.size(), sizeof(h) + sizeof(Node)) == (ssize_t)info.size();
+		close(fd);
+		return ok;
+	}
+
+	//Save the tree like save, but from a forked child process that sees a copy-on-write snapshot of the tree, so the
+	//caller only waits for the fork and can go back to changing the tree right away. The child writes to a temporary
+	//file that it renames over filename once it's complete, so a crash at any point leaves the last complete file in
+	//place. Returns the pid of the child, to be reaped with waitpid, or -1 if the fork failed.
+	//No other thread may change the tree during the call
+	pid_t save_background(const std::string & filename, const Node & root, const std::string & info) const {
+		pid_t pid = fork();
+		if(pid != 0)
+			return pid;
+
+		//only this thread exists in the child, so stick to writing the file and leave without running any destructors
+		Time start;
+		std::string tmp = filename + ".tmp";
+		unlink(tmp.c_str());
+		bool ok = save(tmp, root, info) && rename(tmp.c_str(), filename.c_str()) == 0;
+		if(ok)
+			fprintf(stderr, "Checkpoint: wrote %s in %.0f msec\n", filename.c_str(), (Time() - start)*1000);
+		else
+			fprintf(stderr, "Checkpoint: writing %s failed\n", filename.c_str());
+		_exit(ok ? 0 : 1);
+	}
+
+	//Load a tree written by save into this tree, which must be empty, and hang it off root, replacing the root's stats
+	//with the saved ones. The chunks of the file are read straight into new chunks of this tree, and the only work
+	//done is one pass over them to set the references. Mapping the file instead is no faster, as that pass writes to
+	//every page anyway, and the chunks would miss out on huge pages. Returns the number of nodes loaded in nodes, and
+	//false if the file isn't a tree saved by a build with the same Node. No other thread may use the tree meanwhile
+	bool load(const std::string & filename, Node & root, uint64_t & nodes){
+		assert(!inpass && root.children.empty());
+
+		CompactTreeHeader h;
+		std::string info;
+		if(!CompactTreeHeader::read(filename, h, info) || h.nodesize != sizeof(Node) || h.refsize != sizeof(Ref) ||
+		   h.numchunks == 0 || h.chunksize < h.lastused)
+			return false;
+
+		int fd = open(filename.c_str(), O_RDONLY);
+		if(fd < 0)
+			return false;
+
+		char rootbuf[sizeof(Node)];
+		std::vector<Chunk *> chunks;
+		bool ok = (pread(fd, rootbuf, sizeof(Node), sizeof(h)) == (ssize_t)sizeof(Node));
+		for(unsigned int i = 0; ok && i < h.numchunks; i++){
+			chunks.push_back(new Chunk());
+			ok = chunks.back()->read_file(fd, h.dataoff + (uint64_t)i * h.chunksize, h.chunksize,
+			                              (i + 1 == h.numchunks ? h.lastused : h.chunksize), hugepages);
+		}
+		close(fd);
+		if(!ok){
+			for(Chunk * c : chunks){
+				c->dealloc();
+				delete c;
+			}
+			return false;
+		}
+
+		//point the blocks at each other
+		uint64_t mem = 0, used = 0;
+		auto locate = [&](Ref r){
+			uint64_t pos = ((uint64_t)(uintptr_t)r << 3) - h.dataoff;
+			return (Data *)(chunks[pos / h.chunksize]->mem + pos % h.chunksize);
+		};
+		for(Chunk * c : chunks){
+			used += c->used;
+			for(unsigned int off = 0; off < c->used; ){
+				Data * d = (Data *)(c->mem + off);
+				if(d->filler()){
+					off += d->filler_size();
+					continue;
 				}
-				//go to the next source chunk
-				schunk = schunk->next;
-				soff = 0;
-				//if we're done the static generation, initialize the destination chunk
-				if(schunk){
-					if(schunk->id == generationid){
-						dchunk = schunk;
-						doff = soff;
+				d->set_header();
+				for(Node * n = d->begin(), * e = d->end(); n != e; ++n){
+					if(n->children.data){
+						Data * child = locate(n->children.data);
+						n->children.data = ref(child);
+						child->parent = &(n->children.data);
 					}
-					compactthischunk = (schunk->id >= generationid);
 				}
+				mem += d->mem_size();
+				off += d->mem_size();
+			}
+		}
+
+		memcpy((void *)&root, rootbuf, sizeof(Node));
+		root.children.data = Ref(0);
+		if(h.rootref){
+			Data * d = locate(file_ref(h.rootref));
+			root.children.data = ref(d);
+			d->parent = &(root.children.data);
+		}
+
+		//put the loaded chunks in front of the existing ones, which are empty
+		for(unsigned int i = 0; i + 1 < chunks.size(); i++){
+			chunks[i]->id = i;
+			chunks[i]->next = chunks[i+1];
+		}
+		chunks.back()->id = chunks.size() - 1;
+		chunks.back()->next = head;
+		for(Chunk * c = head; c; c = c->next)
+			c->id += chunks.size();
+		head = chunks[0];
+		current = last = chunks.back();
+		numchunks += chunks.size();
+		memused += mem;
+		chunkused += used;
+
+		nodes = h.nodes;
+		return true;
+	}
+
+private:
+	//a reference in a saved file, the offset of the block in the file in 8 byte words
+	static Ref file_ref(uint64_t r) { return (Ref)(uintptr_t)r; }
+
+	//writes the blocks of a tree to a file in chunks, for save
+	struct Saver {
+		int fd;
+		uint64_t dataoff;
+		unsigned int chunksize;
+		std::vector<char> buf; //the chunk being filled
+		std::vector<Ref> refs; //the file references of the children of the blocks being written, a stack
+		unsigned int off;      //how much of buf is used
+		uint32_t chunks;       //chunks written so far
+		uint64_t nodes;
+		bool ok;
+
+		Saver(int f, uint64_t d, unsigned int c) : fd(f), dataoff(d), chunksize(c), buf(c), off(0), chunks(0), nodes(0), ok(true) { }
+
+		//write the subtree under d, children first, returns the file offset of d in 8 byte words
+		uint64_t write(const Data * d){
+			size_t base = refs.size();
+			for(const Node * n = d->children, * e = d->children + d->used; n != e; ++n){
+				Ref r = n->children.data;
+				refs.push_back(r > Ref(Children::LOCK) && deref(r)->used > 0 ? file_ref(write(deref(r))) : Ref(0));
 			}
+
+			size_t size = Data::size(d->used);
+			if(off + size > chunksize)
+				flush();
+
+			Data * o = (Data *)&buf[off];
+			memcpy((void *)o, (const void *)d, size);
+			o->header = 0;
+			o->capacity = d->used;
+			o->parent = NULL;
+			for(unsigned int i = 0; i < d->used; i++)
+				o->children[i].children.data = refs[base + i];
+			refs.resize(base);
+
+			uint64_t pos = dataoff + (uint64_t)chunks * chunksize + off;
+			off += size;
+			nodes += d->used;
+			ok = ok && (sizeof(Ref) >= 8 || (pos >> 3) < ((uint64_t)1 << 32));
+			return pos >> 3;
+		}
+
+		//write what there is of the current chunk
+		void write_chunk(){
+			ok = ok && pwrite(fd, &buf[0], off, dataoff + (uint64_t)chunks * chunksize) == (ssize_t)off;
 		}
 
+		//fill the rest of this chunk and write it out
+		void flush(){
+			Data::fill(&buf[off], chunksize - off);
+			off = chunksize;
+			write_chunk();
+			chunks++;
+			off = 0;
+		}
+	};
+
+	//all chunks have been compacted, so clean up after the pass
+	void compact_finish(){
+		Chunk * dchunk = pass.dchunk,
+		      * end = pass.end;
+
 		//finish the last used chunk
-		dchunk->used = doff;
+		dchunk->used = pass.doff;
 		dchunk->clear_unused();
 
+		//the chunks after dchunk up to the end of the pass are empty now, so move them after the ones filled during the pass
+		if(dchunk != end){
+			Chunk * empty = dchunk->next;
+			dchunk->next = end->next;
+			end->next = NULL;
+
+			Chunk * tail = dchunk;
+			while(tail->next)
+				tail = tail->next;
+			tail->next = empty;
+
+			for(Chunk * c = empty; c; c = c->next)
+				c->used = 0;
+		}
+
+		//renumber the chunks, and find the last one in use
+		unsigned int id = 0;
+		last = head;
+		chunkused = 0;
+		for(Chunk * c = head; c; c = c->next){
+			c->id = id++;
+			chunkused += c->used;
+			if(c->used > 0)
+				last = c;
+		}
+		numchunks = id;
+
 		//free unused chunks
-		Chunk * del = dchunk;
-		while(del->next && del->id < arenasize*current->id){
+		Chunk * del = last;
+		while(del->next && del->id < pass.arenasize*pass.endid)
 			del = del->next;
-			del->used = 0;
-		}
 
 		if(del->next != NULL){
 			del->next->dealloc(true);
@@ -492,8 +1457,14 @@ public:
 
 		//set current to head in case some chunks aren't filled completely due to generations
 		current = head;
-		last = dchunk;
+		inpass = false;
 	}
 };
 
+#ifdef COMPACTTREE_HANDLES
+template <class Node> char *   CompactTree<Node>::space = NULL;
+template <class Node> uint8_t  CompactTree<Node>::spaceused[CompactTree<Node>::SPACE_SIZE / CompactTree<Node>::HUGE_PAGE_SIZE];
+template <class Node> SpinLock CompactTree<Node>::spacelock;
+#endif
+
 }; // namespace Morat
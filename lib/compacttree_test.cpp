@@ -0,0 +1,293 @@
+
+#include "catch.hpp"
+
+#include "compacttree.h"
+
+namespace Morat {
+
+namespace {
+
+struct Node {
+	uint64_t value;
+	CompactTree<Node>::Children children;
+
+	Node() : value(0) { }
+
+	unsigned int dealloc(CompactTree<Node> & ct){
+		unsigned int num = 0;
+		for(Node * i = children.begin(); i != children.end(); i++)
+			num += i->dealloc(ct);
+		num += children.dealloc(ct);
+		return num;
+	}
+};
+
+//build a tree of the given depth and width, numbering the nodes in the order they're created
+void build(Node & node, int depth, int width, CompactTree<Node>::Arena & arena, uint64_t & count){
+	if(depth == 0)
+		return;
+	node.children.alloc(width, arena);
+	for(auto & child : node.children){
+		child.value = count++;
+		build(child, depth - 1, width, arena, count);
+	}
+}
+
+uint64_t sum(const Node & node){
+	uint64_t s = node.value;
+	for(auto & child : node.children)
+		s += sum(child);
+	return s;
+}
+
+}; // namespace
+
+TEST_CASE("CompactTree::Arena", "[compacttree]") {
+	CompactTree<Node> ct;
+	Node root;
+	uint64_t count = 1;
+
+	{
+		CompactTree<Node>::Arena arena(ct);
+		build(root, 3, 10, arena, count);
+		REQUIRE(count == 1111);
+
+		// freed blocks are reused by the same arena
+		Node temp;
+		temp.children.alloc(10, arena);
+		uint64_t inuse = ct.meminuse();
+		temp.children.dealloc(arena);
+		REQUIRE(ct.meminuse() < inuse);
+		temp.children.alloc(10, arena);
+		REQUIRE(ct.meminuse() == inuse);
+		temp.dealloc(ct);
+	}
+
+	uint64_t total = sum(root);
+	REQUIRE(total == 1110*1111/2);
+
+	// free half the tree, then compact it while an arena is still holding a partial slab
+	CompactTree<Node>::Arena arena(ct);
+	Node temp;
+	temp.children.alloc(7, arena);
+	for(int i = 0; i < 10; i += 2){
+		total -= sum(root.children[i]) - root.children[i].value;
+		root.children[i].dealloc(ct);
+	}
+	temp.dealloc(ct);
+
+	uint64_t inuse = ct.meminuse();
+	ct.compact();
+	REQUIRE(ct.meminuse() == inuse);
+	REQUIRE(sum(root) == total);
+
+	// still usable after compacting
+	build(root.children[0], 2, 5, arena, count);
+	REQUIRE(sum(root) > total);
+
+	root.dealloc(ct);
+	ct.compact();
+	REQUIRE(ct.meminuse() == 0);
+}
+
+TEST_CASE("CompactTree incremental compact", "[compacttree]") {
+	CompactTree<Node> ct;
+	Node root;
+	uint64_t count = 1;
+
+	CompactTree<Node>::Arena arena(ct);
+	build(root, 4, 40, arena, count); // big enough to need a few chunks
+	for(int i = 0; i < 40; i += 2)
+		root.children[i].dealloc(ct);
+	uint64_t total = sum(root);
+
+	ct.compact_start(1, 0, true);
+	REQUIRE(ct.compacting());
+
+	// keep changing the tree in between steps
+	int steps = 0;
+	while(!ct.compact_step(1)){
+		steps++;
+		REQUIRE(sum(root) == total);
+
+		Node & n = root.children[(steps % 10)*2];
+		if(n.children.empty())
+			build(n, 2, 5, arena, count);
+		else
+			n.dealloc(ct);
+		total = sum(root);
+	}
+	REQUIRE(steps > 0);
+	REQUIRE(!ct.compacting());
+	REQUIRE(ct.compact_pauses().num == (unsigned int)steps + 1);
+	REQUIRE(sum(root) == total);
+
+	// the usage tracked through the incremental pass matches a full recount
+	uint64_t inuse = ct.meminuse();
+	ct.compact();
+	REQUIRE(ct.meminuse() == inuse);
+	REQUIRE(sum(root) == total);
+
+	root.dealloc(ct);
+	ct.compact();
+	REQUIRE(ct.meminuse() == 0);
+}
+
+TEST_CASE("CompactTree::Disposer", "[compacttree]") {
+	CompactTree<Node> ct;
+	CompactTree<Node>::Disposer garbage;
+	Node root, keep;
+	uint64_t count = 1;
+
+	CompactTree<Node>::Arena arena(ct);
+	build(root, 3, 10, arena, count); // 1110 nodes in 111 blocks of 10
+	keep.children.swap(root.children[3].children); // 110 nodes in 11 blocks
+	uint64_t kept = sum(keep);
+
+	garbage.add(root);
+	REQUIRE(root.children.empty());
+	REQUIRE_FALSE(garbage.empty());
+
+	// each step frees only the blocks asked for, and leaves the rest of the tree alone
+	int steps = 0;
+	uint64_t freed = 0;
+	while(!garbage.empty()){
+		REQUIRE(garbage.step(arena, 5) == 50);
+		freed += 50;
+		steps++;
+		REQUIRE(sum(keep) == kept);
+	}
+	REQUIRE(steps == 20);
+	REQUIRE(garbage.num_freed() == freed);
+
+	// or all at once
+	garbage.add(keep);
+	REQUIRE(garbage.clear(ct) == 110);
+	REQUIRE(garbage.empty());
+	REQUIRE(garbage.step(arena, 5) == 0);
+
+	ct.compact();
+	REQUIRE(ct.meminuse() == 0);
+}
+
+TEST_CASE("CompactTree save and load", "[compacttree]") {
+	char name[] = "/tmp/compacttree_test_XXXXXX";
+	int fd = mkstemp(name);
+	REQUIRE(fd >= 0);
+	close(fd);
+
+	CompactTree<Node> ct;
+	ct.set_chunk_size(1024*1024); // 2mb, so the tree spans a few chunks
+	Node root;
+	root.value = 7;
+	uint64_t count = 1;
+	{
+		CompactTree<Node>::Arena arena(ct);
+		build(root, 4, 20, arena, count); // 168420 nodes
+	}
+	root.children[5].children[2].children[1].children.shrink(3);
+	uint64_t total = sum(root);
+
+	// never overwrites a file
+	REQUIRE_FALSE(ct.save(name, root, "hello"));
+	unlink(name);
+	REQUIRE(ct.save(name, root, "hello"));
+
+	std::string info;
+	REQUIRE(CompactTreeHeader::read_info(name, info));
+	REQUIRE(info == "hello");
+
+	CompactTree<Node> ct2;
+	Node root2;
+	uint64_t nodes = 0;
+	REQUIRE(ct2.load(name, root2, nodes));
+	unlink(name);
+	REQUIRE(nodes == count - 1 - 17);
+	REQUIRE(root2.value == 7);
+	REQUIRE(sum(root2) == total);
+
+	CompactTree<Node>::MemStats stats = ct2.mem_stats();
+	REQUIRE(stats.nodes == nodes);
+	REQUIRE(stats.slack == 0);
+	REQUIRE(stats.live == ct2.meminuse());
+
+	// the loaded tree is like any other
+	{
+		CompactTree<Node>::Arena arena(ct2);
+		root2.children[0].children[0].children[0].children[0].children.alloc(10, arena);
+		root2.children[3].dealloc(ct2);
+		ct2.compact();
+		REQUIRE(root2.children[0].children[0].children[0].children[0].children.num() == 10);
+		REQUIRE(ct2.mem_stats().live == ct2.meminuse());
+	}
+
+	root.dealloc(ct);
+	root2.dealloc(ct2);
+	ct2.compact();
+	REQUIRE(ct2.meminuse() == 0);
+	REQUIRE(ct2.memarena() == 2*1024*1024); // the loaded chunks are gone too
+}
+
+TEST_CASE("CompactTree chunk size", "[compacttree]") {
+	CompactTree<Node> ct;
+	REQUIRE(ct.memarena() == 16*1024*1024);
+
+	ct.set_huge_pages(0);
+	ct.set_chunk_size(3*1024*1024);
+	REQUIRE(ct.chunk_size() == 4*1024*1024); // rounded up to a multiple of the huge page size
+
+	Node root;
+	uint64_t count = 1;
+	{
+		CompactTree<Node>::Arena arena(ct);
+		build(root, 4, 40, arena, count);
+	}
+	REQUIRE(ct.memarena() > 16*1024*1024);
+	REQUIRE(((ct.memarena() - 16*1024*1024) % (4*1024*1024)) == 0);
+	REQUIRE(ct.memalloced() >= ct.meminuse());
+
+	// compacting an empty tree frees all but the first chunk
+	root.dealloc(ct);
+	ct.compact();
+	REQUIRE(ct.memarena() == 16*1024*1024);
+	REQUIRE(ct.memalloced() == 0);
+}
+
+TEST_CASE("CompactTree size classes", "[compacttree]") {
+	for(bool classes : {false, true}){
+		CompactTree<Node> ct;
+		ct.set_size_classes(classes);
+		REQUIRE(ct.size_classes() == classes);
+
+		// a freed block is reused by a smaller request only if they're in the same size class
+		Node a, b;
+		a.children.alloc(27, ct);
+		a.children.dealloc(ct);
+		uint64_t alloced = ct.memalloced();
+		b.children.alloc(25, ct);
+		REQUIRE((ct.memalloced() == alloced) == classes);
+		REQUIRE(b.children.num() == 25);
+
+		CompactTree<Node>::MemStats stats = ct.mem_stats();
+		REQUIRE(stats.chunks == 1);
+		REQUIRE(stats.reserved == ct.memalloced());
+		REQUIRE(stats.blocks == 1);
+		REQUIRE(stats.nodes == 25);
+		REQUIRE((stats.slack > 0) == classes);
+		REQUIRE(stats.freeblocks == (classes ? 0u : 1u));
+		REQUIRE((stats.live + stats.slack + stats.freemem + stats.filler) == stats.reserved);
+		REQUIRE((stats.live + stats.slack) == ct.meminuse());
+
+		// compacting shrinks the block to the smallest class that fits
+		b.children.shrink(3);
+		ct.compact();
+		stats = ct.mem_stats();
+		REQUIRE(stats.nodes == 3);
+		REQUIRE(stats.slack == 0);
+		REQUIRE(stats.freeblocks == 0);
+		REQUIRE(stats.live == ct.meminuse());
+		b.dealloc(ct);
+	}
+}
+
+}; // namespace Morat
@@ -0,0 +1,115 @@
+#pragma once
+
+//A fixed size table from position hash to proof and disproof numbers and the work spent on it, which is the only memory
+//the df-pn solver has. Nothing points into it, so any entry can be dropped at any time, costing only the work to
+//recompute it. When a bucket is full the entry with the least work behind it is replaced, keeping the ones near the
+//root and the big proofs that are expensive to redo, so the solver runs in a constant amount of memory at a steady
+//speed instead of stopping to garbage collect.
+//Only one thread uses it, so there's no locking.
+
+#include <stdint.h>
+
+#include "bits.h"
+#include "types.h"
+
+namespace Morat {
+
+class DFPNTable {
+	static const unsigned int bucketsize = 4; //how many entries to check before replacing one
+
+	struct Entry {
+		hash_t   hash; //0 means empty
+		uint32_t phi, delta;
+		uint64_t work; //how many nodes were created while searching below this position
+	};
+
+	Entry *  table;
+	uint64_t size; //number of entries, a power of 2
+	uint64_t mask; //size-1, rounded down to the start of a bucket
+	uint64_t used;
+	uint64_t replaced; //how many entries were dropped to make room for another
+
+	static hash_t key(hash_t h){ return (h ? h : 1); }
+	Entry * bucket(hash_t h) const { return table + (mix_bits(h) & mask); }
+
+public:
+	DFPNTable() : table(NULL), size(0), mask(0), used(0), replaced(0) { }
+	~DFPNTable(){
+		if(table)
+			delete[] table;
+		table = NULL;
+	}
+
+	bool     enabled()  const { return (table != NULL); }
+	uint64_t memsize()  const { return size*sizeof(Entry); }
+	uint64_t entries()  const { return size; }
+	uint64_t num_used() const { return used; }
+	uint64_t num_replaced() const { return replaced; }
+
+	//use at most this many bytes, 0 frees it. Loses everything in the table
+	void resize(uint64_t bytes){
+		if(table)
+			delete[] table;
+		table = NULL;
+		size = mask = 0;
+
+		uint64_t num = bytes / sizeof(Entry);
+		if(num < bucketsize)
+			return;
+		size = roundup(num);
+		if(size > num)
+			size /= 2;
+		mask = (size - 1) & ~(uint64_t)(bucketsize - 1);
+		table = new Entry[size];
+		clear();
+	}
+
+	void clear(){
+		for(uint64_t i = 0; i < size; i++){
+			table[i].hash = 0;
+			table[i].phi = table[i].delta = 0;
+			table[i].work = 0;
+		}
+		used = replaced = 0;
+	}
+
+	//the numbers stored for this position, returns false if it isn't in the table
+	bool find(hash_t h, uint32_t & phi, uint32_t & delta, uint64_t & work) const {
+		h = key(h);
+		Entry * b = bucket(h);
+		for(unsigned int i = 0; i < bucketsize; i++){
+			if(b[i].hash == h){
+				phi = b[i].phi;
+				delta = b[i].delta;
+				work = b[i].work;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	//store the numbers for this position, replacing the entry in the bucket with the least work if it's full
+	void store(hash_t h, uint32_t phi, uint32_t delta, uint64_t work){
+		h = key(h);
+		Entry * b = bucket(h);
+		Entry * replace = b;
+		for(unsigned int i = 0; i < bucketsize; i++){
+			if(b[i].hash == h || b[i].hash == 0){
+				replace = b + i;
+				break;
+			}
+			if(b[i].work < replace->work)
+				replace = b + i;
+		}
+		if(replace->hash == 0)
+			used++;
+		else if(replace->hash != h)
+			replaced++;
+		replace->hash = h;
+		replace->phi = phi;
+		replace->delta = delta;
+		replace->work = work;
+	}
+};
+
+}; // namespace Morat
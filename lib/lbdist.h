@@ -10,7 +10,9 @@ Increase distance when crossing an opponent virtual connection?
 Decrease distance when crossing your own virtual connection?
 */
 
+#include <cstring>
 #include <functional>
+#include <stdint.h>
 
 #include "move.h"
 
@@ -34,12 +36,12 @@ and how to look up the value for a given cell.
 
 protected:
 	struct MoveDist {
-		MoveValid pos;
-		int dist;
-		int dir;
+		int16_t xy;
+		uint8_t dist;
+		uint8_t dir;
 
 		MoveDist() { }
-		MoveDist(MoveValid p, int d, int r) : pos(p), dist(d), dir(r) { }
+		MoveDist(int p, int d, int r) : xy(p), dist(d), dir(r) { }
 	};
 
 	//a specialized priority queue
@@ -82,23 +84,33 @@ protected:
 		}
 	};
 
-	int dists[Board::LBDist_directions][2][Board::max_vec_size]; //[edge/corner][player][cell]
+	//stored in a byte each so the whole set stays in cache and resets with a memset. Unreached cells are far, but read
+	//back as maxdist, as that's what the subclasses and their callers compare against. A distance can't reach far
+	//without a path with that many empty cells, so cells that far away are left unreached
+	uint8_t dists[Board::LBDist_directions][2][Board::max_vec_size]; //[edge/corner][player][cell]
 	static const int maxdist = 1000;
+	static const uint8_t far = 255;
 	IntPQueue Q;
 	const Board * board;
+	uint8_t pieces[Board::max_vec_size]; //a copy of who is on each cell, so the flood fills read bytes instead of cells
 
-	int & dist(int edge, Side player, int i)               { return dists[edge][player.to_i() - 1][i]; }
-	int & dist(int edge, Side player, const MoveValid & m) { return dist(edge, player, m.xy); }
-	int & dist(int edge, Side player, const Move & m)      { return dist(edge, player, board->xy(m)); }
-	int & dist(int edge, Side player, int x, int y)        { return dist(edge, player, board->xy(x, y)); }
+	int piece(int i) const { return (i >= 0 ? pieces[i] : 0); }
+
+	int dist(int edge, Side player, int i) const {
+		uint8_t d = dists[edge][player.to_i() - 1][i];
+		return (d == far ? maxdist : d);
+	}
+	int dist(int edge, Side player, const MoveValid & m) const { return dist(edge, player, m.xy); }
+	int dist(int edge, Side player, const Move & m)      const { return dist(edge, player, board->xy(m)); }
+	int dist(int edge, Side player, int x, int y)        const { return dist(edge, player, board->xy(x, y)); }
 
 	void init(int x, int y, int edge, Side player, int dir){
 		Side val = board->get(x, y);
 		if(val != ~player){
 			bool empty = (val == Side::NONE);
-			MoveValid move(x, y, board->xy(x, y));
-			Q.push(MoveDist(move, empty, dir));
-			dist(edge, player, move) = empty;
+			int xy = board->xy(x, y);
+			Q.push(MoveDist(xy, empty, dir));
+			dists[edge][player.to_i() - 1][xy] = empty;
 		}
 	}
 
@@ -113,8 +125,10 @@ public:
 
 		for(int i = 0; i < Board::LBDist_directions; i++)
 			for(int j = 0; j < 2; j++)
-				for(int k = 0; k < board->vec_size(); k++)
-					dists[i][j][k] = maxdist; //far far away!
+				memset(dists[i][j], far, board->vec_size()); //far far away!
+
+		for(int i = 0; i < board->vec_size(); i++)
+			pieces[i] = board->get(i).to_i();
 
 		if((side & Side::P1) == Side::P1) self()->init_player(crossvcs, Side::P1);
 		if((side & Side::P2) == Side::P2) self()->init_player(crossvcs, Side::P2);
@@ -146,33 +160,36 @@ protected:
 	int _get(int pos, Side player);
 
 	void flood(int edge, Side player, bool crossvcs){
-		Side otherplayer = ~player;
+		int otherplayer = (~player).to_i();
+		uint8_t * d = dists[edge][player.to_i() - 1];
 
 		MoveDist cur;
 		while(Q.pop(cur)){
-			const MoveValid* neighbors = board->neighbors(cur.pos);
+			const MoveValid* neighbors = board->neighbors(cur.xy);
 			for(int i = 5; i <= 7; i++){
 				int nd = (cur.dir + i) % 6;
-				MoveDist next(neighbors[nd], cur.dist, nd);
+				int next = neighbors[nd].xy;
+				int dist = cur.dist;
 
-				if(board->on_board(next.pos)){
-					Side colour = board->get(next.pos);
+				if(next >= 0){ //on the board
+					int colour = pieces[next];
 
 					if(colour == otherplayer)
 						continue;
 
-					if(colour == Side::NONE){
+					if(colour == 0){ //empty
 						if(!crossvcs && //forms a vc
-						   board->get(neighbors[(nd + 5) % 6]) == otherplayer &&
-						   board->get(neighbors[(nd + 7) % 6]) == otherplayer)
+						   piece(neighbors[(nd + 5) % 6].xy) == otherplayer &&
+						   piece(neighbors[(nd + 7) % 6].xy) == otherplayer)
 							continue;
 
-						next.dist++;
+						if(++dist == far)
+							continue;
 					}
 
-					if( dist(edge, player, next.pos) > next.dist){
-						dist(edge, player, next.pos) = next.dist;
-						Q.push(next);
+					if(d[next] > dist){
+						d[next] = dist;
+						Q.push(MoveDist(next, dist, nd));
 					}
 				}
 			}
@@ -9,14 +9,25 @@ namespace Morat {
 
 template<class Board>
 struct MoveList {
-	ExpPair    exp[2];       //aggregated outcomes overall
-	ExpPair    rave[2][Board::max_vec_size]; //aggregated outcomes per move
-	MovePlayer moves[Board::max_vec_size];   //moves made in order
-	int        tree;         //number of moves in the tree
-	int        rollout;      //number of moves in the rollout
-	Board *    board;        //reference to rootboard for xy()
+	//the rave outcomes for a move are only valid if they're from this iteration's generation, so reset doesn't need
+	//to clear the whole board worth of them on every iteration, just the ones played are cleared as they're used
+	struct Rave {
+		ExpPair      exp;
+		unsigned int gen;
+	};
 
-	MoveList() : tree(0), rollout(0), board(NULL) { }
+	ExpPair      exp[2];       //aggregated outcomes overall
+	Rave         rave[2][Board::max_vec_size]; //aggregated outcomes per move
+	MovePlayer   moves[Board::max_vec_size];   //moves made in order
+	int          tree;         //number of moves in the tree
+	int          rollout;      //number of moves in the rollout
+	unsigned int gen;          //current generation for rave
+	ExpPair      none;         //the rave for moves that weren't played
+	Board *      board;        //reference to rootboard for xy()
+
+	MoveList() : tree(0), rollout(0), gen(1), board(NULL) {
+		clear_rave();
+	}
 
 	void addtree(const Move & move, Side player){
 		moves[tree++] = MovePlayer(move, player);
@@ -30,9 +41,17 @@ struct MoveList {
 		board = b;
 		exp[0].clear();
 		exp[1].clear();
-		for(int i = 0; i < b->vec_size(); i++){
-			rave[0][i].clear();
-			rave[1][i].clear();
+		if(++gen == 0){ //wrapped around, so old stamps could look current
+			clear_rave();
+			gen = 1;
+		}
+	}
+	void clear_rave(){
+		for(auto & side : rave){
+			for(auto & r : side){
+				r.exp.clear();
+				r.gen = 0;
+			}
 		}
 	}
 	void finishrollout(Outcome won){
@@ -45,7 +64,12 @@ struct MoveList {
 			exp[won.to_i() - 1].addwin();
 
 			for(MovePlayer * i = begin(), * e = end(); i != e; i++){
-				ExpPair & r = rave[i->player.to_i() - 1][board->xy(*i)];
+				Rave & rv = rave[i->player.to_i() - 1][board->xy(*i)];
+				if(rv.gen != gen){
+					rv.gen = gen;
+					rv.exp.clear();
+				}
+				ExpPair & r = rv.exp;
 				r.addloss();
 				if(+i->player == won)
 					r.addwin();
@@ -70,7 +94,8 @@ struct MoveList {
 		exp[1].addlosses(-n);
 	}
 	const ExpPair & getrave(Side player, const Move & move) const {
-		return rave[player.to_i() - 1][board->xy(move)];
+		const Rave & rv = rave[player.to_i() - 1][board->xy(move)];
+		return (rv.gen == gen ? rv.exp : none);
 	}
 	const ExpPair & getexp(Side player) const {
 		return exp[player.to_i() - 1];
@@ -0,0 +1,51 @@
+
+#include "catch.hpp"
+
+#include "movelist.h"
+
+namespace Morat {
+
+namespace {
+
+struct Board {
+	static const int max_vec_size = 9;
+	int xy(const Move & m) const { return m.y*3 + m.x; }
+};
+
+}; // namespace
+
+TEST_CASE("MoveList rave", "[movelist]") {
+	Board board;
+	MoveList<Board> movelist;
+
+	movelist.reset(&board);
+	movelist.addtree(Move("a1"), Side::P1);
+	movelist.addrollout(Move("b1"), Side::P2);
+	movelist.addrollout(Move("c1"), Side::P1);
+	movelist.finishrollout(Outcome::P1);
+
+	REQUIRE(movelist.getrave(Side::P1, Move("a1")).num() == 1);
+	REQUIRE(movelist.getrave(Side::P1, Move("a1")).avg() == 1.0f);
+	REQUIRE(movelist.getrave(Side::P2, Move("b1")).avg() == 0.0f);
+	REQUIRE(movelist.getrave(Side::P2, Move("a1")).num() == 0);
+	REQUIRE(movelist.getrave(Side::P1, Move("b2")).num() == 0);
+
+	// a second rollout in the same iteration adds to it
+	movelist.addrollout(Move("c1"), Side::P1);
+	movelist.finishrollout(Outcome::P2);
+	REQUIRE(movelist.getrave(Side::P1, Move("c1")).num() == 2);
+	REQUIRE(movelist.getrave(Side::P1, Move("c1")).avg() == 0.5f);
+
+	// the next iteration starts with nothing, but without clearing the moves it doesn't touch
+	movelist.reset(&board);
+	REQUIRE(movelist.getrave(Side::P1, Move("a1")).num() == 0);
+	REQUIRE(movelist.getrave(Side::P1, Move("c1")).num() == 0);
+
+	movelist.addtree(Move("a1"), Side::P1);
+	movelist.finishrollout(Outcome::P2);
+	REQUIRE(movelist.getrave(Side::P1, Move("a1")).num() == 1);
+	REQUIRE(movelist.getrave(Side::P1, Move("a1")).avg() == 0.0f);
+	REQUIRE(movelist.getrave(Side::P1, Move("c1")).num() == 0);
+}
+
+}; // namespace Morat
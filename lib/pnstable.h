@@ -0,0 +1,125 @@
+#pragma once
+
+//A fixed size, lock free table from position hash to proof and disproof numbers, shared by all threads so the PNS tree
+//can reuse what it learned about a position for all the move orders that reach it. Proven results are exact, so they
+//are kept over anything else. Unproven numbers are only estimates, good for starting a new node off where a
+//transposition left off.
+//Each entry stores the hash xor'd with the data, so a read that races with a write to the same entry is seen as a
+//miss instead of mixing the numbers of two positions. It holds no references into the tree, so garbage collection
+//and compaction can move or free nodes without telling it.
+
+#include <stdint.h>
+
+#include "bits.h"
+#include "types.h"
+
+namespace Morat {
+
+class PNSTable {
+	static const unsigned int bucketsize = 4; //how many entries to check before replacing one
+
+	struct Entry {
+		volatile uint64_t check; //hash ^ data, 0 means empty
+		volatile uint64_t data;  //phi in the high half, delta in the low half
+	};
+
+	Entry *  table;
+	uint64_t size; //number of entries, a power of 2
+	uint64_t mask; //size-1, rounded down to the start of a bucket
+
+	static hash_t key(hash_t h){ return (h ? h : 1); }
+	Entry * bucket(hash_t h) const { return table + (mix_bits(h) & mask); }
+
+	static uint64_t pack(uint32_t phi, uint32_t delta){ return ((uint64_t)phi << 32) | delta; }
+	static bool proven(uint64_t data){ return (data >> 32) == 0 || (uint32_t)data == 0; }
+
+	//how much an entry is worth keeping, proven ones most of all, then the ones with bigger numbers as they took
+	//more work to get to
+	static uint64_t value(uint64_t data){ return (proven(data) ? ~(uint64_t)0 : (data >> 32) + (uint32_t)data); }
+
+public:
+	PNSTable() : table(NULL), size(0), mask(0) { }
+	~PNSTable(){
+		if(table)
+			delete[] table;
+		table = NULL;
+	}
+
+	bool enabled() const { return (table != NULL); }
+	uint64_t memsize() const { return size*sizeof(Entry); }
+	uint64_t entries() const { return size; }
+
+	//use at most this many bytes, 0 disables it. Not thread safe, and loses everything in the table
+	void resize(uint64_t bytes){
+		if(table)
+			delete[] table;
+		table = NULL;
+		size = mask = 0;
+
+		uint64_t num = bytes / sizeof(Entry);
+		if(num < bucketsize)
+			return;
+		size = roundup(num);
+		if(size > num)
+			size /= 2;
+		mask = (size - 1) & ~(uint64_t)(bucketsize - 1);
+		table = new Entry[size];
+		clear();
+	}
+
+	void clear(){
+		for(uint64_t i = 0; i < size; i++){
+			table[i].check = 0;
+			table[i].data = 0;
+		}
+	}
+
+	//the numbers stored for this position, returns false if it isn't in the table
+	bool find(hash_t h, uint32_t & phi, uint32_t & delta) const {
+		h = key(h);
+		Entry * b = bucket(h);
+		for(unsigned int i = 0; i < bucketsize; i++){
+			uint64_t data = b[i].data, check = b[i].check;
+			if((check ^ data) == h){
+				phi = data >> 32;
+				delta = (uint32_t)data;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	//store the numbers for this position. A proven position is never overwritten by an unproven one, and when the
+	//bucket is full the entry least worth keeping is replaced. Unproven numbers aren't stored at all if every entry
+	//in the bucket is proven
+	void store(hash_t h, uint32_t phi, uint32_t delta){
+		h = key(h);
+		uint64_t data = pack(phi, delta);
+		Entry * b = bucket(h);
+		Entry * replace = NULL;
+		uint64_t replacevalue = ~(uint64_t)0;
+		for(unsigned int i = 0; i < bucketsize; i++){
+			uint64_t d = b[i].data, check = b[i].check;
+			if((check ^ d) == h){
+				if(proven(d) && !proven(data))
+					return;
+				replace = b + i;
+				break;
+			}
+			uint64_t v = (check == 0 ? 0 : value(d));
+			if(v < replacevalue){
+				replace = b + i;
+				replacevalue = v;
+			}
+		}
+		if(!replace){ //all proven
+			if(!proven(data))
+				return;
+			replace = b;
+		}
+		replace->data = data;
+		replace->check = h ^ data;
+	}
+};
+
+}; // namespace Morat
@@ -0,0 +1,75 @@
+
+#include "catch.hpp"
+
+#include "pnstable.h"
+
+namespace Morat {
+
+TEST_CASE("PNSTable", "[pnstable]") {
+	PNSTable tt;
+	REQUIRE(!tt.enabled());
+
+	tt.resize(1000*16);
+	REQUIRE(tt.enabled());
+	REQUIRE(tt.entries() == 512); // rounded down to a power of 2
+
+	uint32_t phi = 0, delta = 0;
+	REQUIRE(!tt.find(12345, phi, delta));
+
+	tt.store(12345, 3, 5);
+	REQUIRE(tt.find(12345, phi, delta));
+	REQUIRE(phi == 3);
+	REQUIRE(delta == 5);
+	REQUIRE(!tt.find(54321, phi, delta));
+	REQUIRE(!tt.find(0, phi, delta));
+
+	// newer numbers replace older ones, until it's proven
+	tt.store(12345, 7, 2);
+	REQUIRE(tt.find(12345, phi, delta));
+	REQUIRE(phi == 7);
+	REQUIRE(delta == 2);
+	tt.store(12345, 0, 1000);
+	tt.store(12345, 4, 4);
+	REQUIRE(tt.find(12345, phi, delta));
+	REQUIRE(phi == 0);
+	REQUIRE(delta == 1000);
+
+	// a full table keeps the proven entries over the rest
+	for(hash_t h = 1; h < 10000; h++)
+		if(h != 12345)
+			tt.store(h, 1, 1);
+	REQUIRE(tt.find(12345, phi, delta));
+	REQUIRE(phi == 0);
+
+	tt.clear();
+	REQUIRE(!tt.find(12345, phi, delta));
+
+	tt.resize(0);
+	REQUIRE(!tt.enabled());
+}
+
+TEST_CASE("PNSTable bucket full of proofs", "[pnstable]") {
+	PNSTable tt;
+	tt.resize(4*16);
+	REQUIRE(tt.entries() == 4); // a single bucket
+
+	for(hash_t h = 1; h <= 4; h++)
+		tt.store(h, 0, 1000 + h);
+
+	// unproven numbers don't replace any of them
+	uint32_t phi = 0, delta = 0;
+	tt.store(5, 3, 5);
+	REQUIRE(!tt.find(5, phi, delta));
+	for(hash_t h = 1; h <= 4; h++){
+		REQUIRE(tt.find(h, phi, delta));
+		REQUIRE(phi == 0);
+		REQUIRE(delta == 1000 + h);
+	}
+
+	// but another proof does
+	tt.store(6, 1000, 0);
+	REQUIRE(tt.find(6, phi, delta));
+	REQUIRE(delta == 0);
+}
+
+}; // namespace Morat
@@ -0,0 +1,100 @@
+#pragma once
+
+//Decides when to stop a timed search based on how settled the root is, instead of always using the whole time given.
+//The search threads ask every so often, passing the visits of the two most visited root children. It stops early once
+//the second can't catch up to the first even if it got every remaining run, and with extend > 1 it keeps going past the
+//time given while the best move changed recently or the top two are close. The hard limit of time*extend, capped at
+//the time left on the clock, is enforced by the pool's timer, so this only ever cuts a search short. Any time saved
+//goes back to the game clock as the gtp layer only charges the time actually used, but only if the clock is flexible.
+//A clock that doesn't bank unused time would throw away what an early stop saves, and an extension would spend time
+//the moves never banked, so neither is done then.
+
+#include <algorithm>
+
+#include "thread.h"
+#include "time.h"
+
+namespace Morat {
+
+class TimeManager {
+public:
+	bool  earlystop; //stop once the best move can't be overtaken in the time left
+	float extend;    //search up to this multiple of the time given while the best move is unsettled, 1 to never extend
+	float close;     //the top two are close if the second has at least this fraction of the visits of the first
+	float recent;    //the best move changed recently if it was in the last this fraction of the time given
+
+	static const int checks = 20; //how many times to check over the time given
+
+private:
+	Time     start;
+	double   soft, hard;       //the time given, and the most it can be extended to
+	volatile double nextcheck; //seconds after start
+	double   changed;          //when the best move last changed
+	int      best;
+	volatile bool active;
+	SpinLock lock;
+
+public:
+	TimeManager() : earlystop(false), extend(1), close(0.75), recent(0.25),
+		soft(0), hard(0), nextcheck(0), changed(0), best(-1), active(false) { }
+
+	bool enabled() const { return earlystop || extend > 1; }
+
+	//start timing a search of the given length, returns the hard limit for the pool's timer. It only extends as far as
+	//the time left on the clock, 0 for no clock, but never cuts the time given. A clock that isn't flexible gets just
+	//the time given
+	double begin(double time, double clock = 0, bool flexible = true) {
+		start = Time();
+		soft = time;
+		hard = time * (extend > 1 && flexible ? extend : 1);
+		if(clock > 0)
+			hard = std::max(time, std::min(hard, clock));
+		nextcheck = soft / checks;
+		changed = 0;
+		best = -1;
+		active = (time > 0 && flexible && enabled());
+		return hard;
+	}
+
+	//stop checking, like while pondering
+	void end() { active = false; }
+
+	//whether it's time to check again. Only one thread gets a true at a time, and it must then call check
+	bool due() {
+		return active && Time() - start >= nextcheck && lock.trylock();
+	}
+
+	//given the visits of the most and second most visited root children, the index of the most visited one, and the
+	//visits of all the root children, return whether to stop now
+	bool check(uint64_t first, uint64_t second, int bestidx, uint64_t total) {
+		double now = Time() - start;
+		bool stop = decide(now, first, second, bestidx, total);
+		nextcheck = now + soft / checks;
+		lock.unlock();
+		return stop;
+	}
+
+	//the decision itself, separate from the clock to be testable
+	bool decide(double now, uint64_t first, uint64_t second, int bestidx, uint64_t total) {
+		if(bestidx != best){
+			best = bestidx;
+			changed = now;
+		}
+
+		if(now <= 0 || first == 0)
+			return false;
+
+		if(now < soft){
+			//assume the second best gets all the runs in the time left
+			double left = total / now * (soft - now);
+			return earlystop && first > second + left;
+		}
+
+		//past the time given, only reachable when extending
+		bool unstable = (now - changed < soft * recent);
+		bool near = (second >= close * first);
+		return !(unstable || near);
+	}
+};
+
+}; // namespace Morat
@@ -0,0 +1,57 @@
+#include "catch.hpp"
+#include "timemanager.h"
+
+
+namespace Morat {
+
+TEST_CASE("disabled", "[timemanager]") {
+	TimeManager tm;
+	REQUIRE_FALSE(tm.enabled());
+	REQUIRE(tm.begin(10) == 10);
+	REQUIRE_FALSE(tm.due());
+}
+
+TEST_CASE("early stop", "[timemanager]") {
+	TimeManager tm;
+	tm.earlystop = true;
+	REQUIRE(tm.begin(10) == 10);
+
+	REQUIRE_FALSE(tm.decide(5, 4000, 1000, 0, 5000)); // 1000/s, 5000 left could still catch up
+	REQUIRE(tm.decide(8, 6000, 1000, 0, 8000));       // 2000 left can't
+	REQUIRE_FALSE(tm.decide(8, 6000, 4500, 0, 8000)); // but could from closer
+
+	tm.earlystop = false;
+	REQUIRE_FALSE(tm.decide(8, 6000, 1000, 0, 8000));
+}
+
+TEST_CASE("extend", "[timemanager]") {
+	TimeManager tm;
+	tm.extend = 2;
+	REQUIRE(tm.begin(10) == 20);
+
+	REQUIRE_FALSE(tm.decide(1, 100, 90, 0, 200));
+	REQUIRE_FALSE(tm.decide(9, 1000, 900, 1, 2000));     // best changed at 9
+	REQUIRE_FALSE(tm.decide(10.5, 5000, 1000, 1, 6000)); // which is recent
+	REQUIRE(tm.decide(12, 5000, 1000, 1, 6000));         // and now isn't
+	REQUIRE_FALSE(tm.decide(12, 5000, 4000, 1, 9000));   // top two are close
+}
+
+TEST_CASE("extend within the clock", "[timemanager]") {
+	TimeManager tm;
+	tm.extend = 3;
+	REQUIRE(tm.begin(10, 100) == 30); // plenty of time left
+	REQUIRE(tm.begin(10, 25) == 25);  // only extends as far as the clock
+	REQUIRE(tm.begin(10, 5) == 10);   // but doesn't cut the time given
+	REQUIRE(tm.begin(10, 0) == 30);   // no clock
+}
+
+TEST_CASE("clock that isn't flexible", "[timemanager]") {
+	TimeManager tm;
+	tm.earlystop = true;
+	tm.extend = 3;
+	REQUIRE(tm.begin(10, 100, false) == 10); // spending more would take time that was never banked
+	REQUIRE_FALSE(tm.due());                 // and stopping early would throw the rest away
+	REQUIRE(tm.begin(10, 100, true) == 30);
+}
+
+}; // namespace Morat
@@ -0,0 +1,138 @@
+#pragma once
+
+//A fixed size table from position hash to experience, shared by all threads. MCTS uses it to give a new node a prior
+//from what its position learned through other move orders, the table itself doesn't link parts of the tree.
+//A thread writing an entry claims it first by swapping its hash for LOCKED, so a visit is never added to an entry
+//that's being replaced by another position. Readers check the hash again after copying the experience, and treat a
+//change as a miss. A write that finds its entry claimed is dropped, MCTS statistics are approximate anyway.
+//It holds no references into the tree, so garbage collection and compaction can move or free nodes without
+//telling it. Stale entries are dropped by gc, or replaced when their bucket is full.
+
+#include <atomic>
+#include <stdint.h>
+
+#include "bits.h"
+#include "exppair.h"
+#include "thread.h"
+#include "types.h"
+
+namespace Morat {
+
+class TransTable {
+	static const unsigned int bucketsize = 4; //how many entries to check before replacing one
+
+	static const hash_t LOCKED = 1; //claimed by a thread writing it
+
+	struct Entry {
+		volatile hash_t hash; //0 means empty
+		ExpPair exp;
+	};
+
+	Entry *  table;
+	uint64_t size; //number of entries, a power of 2
+	uint64_t mask; //size-1, rounded down to the start of a bucket
+
+	static hash_t key(hash_t h){ return (h > LOCKED ? h : h + 2); }
+	Entry * bucket(hash_t h) const { return table + (mix_bits(h) & mask); }
+
+public:
+	TransTable() : table(NULL), size(0), mask(0) { }
+	~TransTable(){
+		if(table)
+			delete[] table;
+		table = NULL;
+	}
+
+	bool enabled() const { return (table != NULL); }
+	uint64_t memsize() const { return size*sizeof(Entry); }
+	uint64_t entries() const { return size; }
+
+	//use at most this many bytes, 0 disables it. Not thread safe, and loses everything in the table
+	void resize(uint64_t bytes){
+		if(table)
+			delete[] table;
+		table = NULL;
+		size = mask = 0;
+
+		uint64_t num = bytes / sizeof(Entry);
+		if(num < bucketsize)
+			return;
+		size = roundup(num);
+		if(size > num)
+			size /= 2;
+		mask = (size - 1) & ~(uint64_t)(bucketsize - 1);
+		table = new Entry[size];
+		clear();
+	}
+
+	void clear(){
+		for(uint64_t i = 0; i < size; i++){
+			table[i].hash = 0;
+			table[i].exp.clear();
+		}
+	}
+
+	//copy the experience for this position, returns false if it isn't in the table
+	bool find(hash_t h, ExpPair & exp) const {
+		h = key(h);
+		Entry * b = bucket(h);
+		for(unsigned int i = 0; i < bucketsize; i++){
+			if(b[i].hash == h){
+				exp = b[i].exp;
+				std::atomic_thread_fence(std::memory_order_acquire);
+				return (b[i].hash == h); //it wasn't replaced while copying
+			}
+		}
+		return false;
+	}
+
+	//add the result of one visit, with the virtual loss already balanced like the tree does. It goes to the entry for
+	//this position, or an empty one, or replaces the least experienced one when the bucket is full
+	void add(hash_t h, const ExpPair & e){
+		h = key(h);
+		Entry * b = bucket(h);
+		Entry * replace = NULL;
+		hash_t replacehash = 0;
+		for(unsigned int i = 0; i < bucketsize; i++){
+			hash_t cur = b[i].hash;
+			if(cur == LOCKED) //may be this position, don't risk adding it twice
+				return;
+			if(cur == h){
+				replace = b + i;
+				replacehash = cur;
+				break;
+			}
+			if(!replace || (replacehash != 0 && (cur == 0 || b[i].exp.num() < replace->exp.num()))){
+				replace = b + i;
+				replacehash = cur;
+			}
+		}
+
+		if(!CAS(replace->hash, replacehash, LOCKED))
+			return;
+		if(replacehash != h)
+			replace->exp.clear();
+		replace->exp.addloss();
+		replace->exp += e;
+		CAS(replace->hash, LOCKED, h);
+	}
+
+	//drop the entries with less than limit experience, so the space goes to positions that still matter
+	//assume this is the only thread running, returns how many entries remain
+	uint64_t gc(uword limit){
+		uint64_t remain = 0;
+		for(uint64_t i = 0; i < size; i++){
+			if(table[i].hash == 0)
+				continue;
+			if(table[i].exp.num() < limit){
+				table[i].hash = 0;
+				table[i].exp.clear();
+			}else{
+				remain++;
+			}
+		}
+		return remain;
+	}
+};
+
+}; // namespace Morat
@@ -0,0 +1,56 @@
+
+#include "catch.hpp"
+
+#include "transtable.h"
+
+namespace Morat {
+
+TEST_CASE("TransTable", "[transtable]") {
+	TransTable tt;
+	REQUIRE(!tt.enabled());
+
+	tt.resize(1000*24);
+	REQUIRE(tt.enabled());
+	REQUIRE(tt.entries() == 512); // rounded down to a power of 2
+
+	ExpPair exp;
+	REQUIRE(!tt.find(12345, exp));
+
+	ExpPair win;
+	win.addwin();
+	tt.add(12345, win);
+	tt.add(12345, ExpPair());
+	REQUIRE(tt.find(12345, exp));
+	REQUIRE(exp.num() == 2);
+	REQUIRE(exp.avg() == 0.5);
+	REQUIRE(!tt.find(54321, exp));
+	REQUIRE(!tt.find(0, exp));
+
+	// a full table replaces the least experienced entry in the bucket, so nothing is lost that matters more
+	for(hash_t h = 2; h < 10000; h++)
+		if(h != 12345)
+			tt.add(h, ExpPair());
+	REQUIRE(tt.find(12345, exp));
+	REQUIRE(exp.num() == 2);
+
+	// gc drops the ones without enough experience
+	REQUIRE(tt.gc(2) == 1);
+	REQUIRE(tt.find(12345, exp));
+	REQUIRE(!tt.find(9999, exp));
+
+	tt.clear();
+	REQUIRE(!tt.find(12345, exp));
+
+	// 0 and 1 are free to use as positions too, despite the values the table uses itself
+	tt.add(0, ExpPair());
+	tt.add(1, win);
+	REQUIRE(tt.find(0, exp));
+	REQUIRE(exp.num() == 1);
+	REQUIRE(tt.find(1, exp));
+	REQUIRE(exp.avg() == 1);
+
+	tt.resize(0);
+	REQUIRE(!tt.enabled());
+}
+
+}; // namespace Morat
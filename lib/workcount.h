@@ -0,0 +1,69 @@
+#pragma once
+
+//Counts of how much work went into a subtree, the number of nodes searched below it. Solvers use it to decide which
+//parts of the tree are worth keeping when memory runs out, so it only needs to be roughly right once it's large.
+//Both count the same way, and add() is safe to call from many threads at once.
+
+#include <stdint.h>
+
+#include "thread.h"
+
+namespace Morat {
+
+//The exact count, 8 bytes.
+class WorkCount {
+	uint64_t n;
+public:
+	WorkCount(uint64_t v = 0) : n(v) { }
+	operator uint64_t () const { return n; }
+
+	void add(uint64_t v, uint32_t rand){ PLUS(n, v); }
+};
+
+//An approximate count in 1 byte, like a tiny float with a 5 bit exponent and 3 bit mantissa. It's exact up to 15,
+//within 1/8 of the count past that, and saturates at 15<<30, about 16 billion. Adding rounds up or down at random in
+//proportion to the remainder, so that the many small additions a big subtree gets add up to the right total on
+//average instead of all being rounded away.
+class WorkCountLog8 {
+	uint8_t c;
+
+public:
+	static const uint64_t max = (uint64_t)15 << 30;
+
+	static uint64_t decode(uint8_t c) {
+		unsigned int e = c >> 3;
+		return (e ? (uint64_t)(8 + (c & 7)) << (e - 1) : c);
+	}
+
+	//rand is a random number to round with, 0 always rounds down
+	static uint8_t encode(uint64_t v, uint32_t rand) {
+		if(v < 16)
+			return v;
+		if(v >= max)
+			return 255;
+
+		unsigned int shift = 60 - __builtin_clzll(v); //keep the top 4 bits
+		uint64_t base = v >> shift;
+		uint64_t mask = ((uint64_t)1 << shift) - 1;
+		if((rand & mask) + (v & mask) > mask) //the remainder decides how likely it rounds up
+			base++;
+		if(base == 16){
+			base = 8;
+			shift++;
+		}
+		return ((shift + 1) << 3) | (base - 8);
+	}
+
+	WorkCountLog8(uint64_t v = 0) : c(encode(v, 0)) { }
+	operator uint64_t () const { return decode(c); }
+
+	void add(uint64_t v, uint32_t rand){
+		uint8_t old, val;
+		do{
+			old = c;
+			val = encode(decode(old) + v, rand);
+		}while(val != old && !CAS(c, old, val));
+	}
+};
+
+}; // namespace Morat
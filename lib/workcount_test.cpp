@@ -0,0 +1,54 @@
+#include "catch.hpp"
+
+#include "workcount.h"
+#include "xorshift.h"
+
+namespace Morat {
+
+TEST_CASE("WorkCount", "[workcount]") {
+	WorkCount w;
+	REQUIRE(w == 0u);
+	w.add(5, 0);
+	w.add(123456789, 0);
+	REQUIRE(w == 123456794u);
+	w = 7;
+	REQUIRE(w == 7u);
+}
+
+TEST_CASE("WorkCountLog8", "[workcount]") {
+	REQUIRE(sizeof(WorkCountLog8) == 1);
+
+	// every code decodes to a value that encodes back to it, in increasing order
+	for(unsigned int c = 0; c < 256; c++){
+		REQUIRE(WorkCountLog8::encode(WorkCountLog8::decode(c), 0) == c);
+		if(c > 0)
+			REQUIRE(WorkCountLog8::decode(c - 1) < WorkCountLog8::decode(c));
+	}
+	REQUIRE(WorkCountLog8::decode(255) == (uint64_t)WorkCountLog8::max);
+
+	// exact when small, then rounds down without a random number
+	for(uint64_t v = 0; v < 16; v++)
+		REQUIRE(WorkCountLog8(v) == v);
+	REQUIRE(WorkCountLog8(100) == 96u);
+	REQUIRE(WorkCountLog8(1000000) == 983040u);
+
+	// saturates instead of wrapping
+	WorkCountLog8 w(WorkCountLog8::max - 1);
+	w.add(WorkCountLog8::max, 12345);
+	REQUIRE(w == (uint64_t)WorkCountLog8::max);
+
+	// many small additions to big counts keep the right total on average
+	XORShift_uint32 rand(42);
+	uint64_t sum = 0, expected = 0;
+	for(int n = 0; n < 64; n++){
+		WorkCountLog8 big(1000000);
+		expected += big + 20000*50;
+		for(int i = 0; i < 20000; i++)
+			big.add(50, rand());
+		sum += big;
+	}
+	REQUIRE(sum > expected * 0.9);
+	REQUIRE(sum < expected * 1.1);
+}
+
+}; // namespace Morat
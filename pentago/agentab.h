@@ -86,6 +86,10 @@ public:
 			TT = NULL;
 		}
 	}
+
+	std::string mem_stats(){
+		return "TT: " + to_str(maxnodes) + " nodes, " + to_str(maxnodes*sizeof(Node)/(1024*1024)) + " Mb";
+	}
 	void reset(){
 		timeout = false;
 		maxdepth = 0;
@@ -109,6 +113,16 @@ public:
 		logerr("load_sgf not supported in the ab agent.");
 	}
 
+	bool save_tree(const std::string & filename, const std::string & info) {
+		logerr("save_tree not supported in the ab agent.");
+		return false;
+	}
+
+	bool load_tree(const std::string & filename) {
+		logerr("load_tree not supported in the ab agent.");
+		return false;
+	}
+
 private:
 	int16_t negamax(const Board & board, int16_t alpha, int16_t beta, int depth);
 	Move return_move(const Board & board, int verbose = 0) const;
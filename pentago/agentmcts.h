@@ -13,6 +13,8 @@
 #include "../lib/log.h"
 #include "../lib/thread.h"
 #include "../lib/time.h"
+#include "../lib/timemanager.h"
+#include "../lib/transtable.h"
 #include "../lib/types.h"
 #include "../lib/xorshift.h"
 
@@ -151,15 +153,31 @@ public:
 		bool use_explore; //whether to use exploration for this simulation
 		MoveList movelist;
 		int stage; //which of the four MCTS stages is it on
+		CompactTree<Node>::Arena arena; //thread local memory for creating children
+
+		//runs and root experience are batched up so the threads don't all fight over the same cache lines every run
+		static const uint flushruns = 16;
+		static const uint disposeblocks = 64; //blocks of the old tree to free per run while there are any
+		uint     pendingruns;
+		ExpPair  pendingexp;
 
 	public:
 		DepthStats treelen, gamelen;
 		double times[4]; //time spent in each of the stages
 		Time timestamps[4]; //timestamps for the beginning, before child creation, before rollout, after rollout
 
-		AgentThread(AgentThreadPool<AgentMCTS> * p, AgentMCTS * a) : AgentThreadBase<AgentMCTS>(p, a) { }
+		AgentThread(AgentThreadPool<AgentMCTS> * p, AgentMCTS * a) : AgentThreadBase<AgentMCTS>(p, a), arena(a->ctmem), pendingruns(0) { }
 
 
+		void flush(){
+			if(pendingruns){
+				PLUS(agent->runs, pendingruns);
+				agent->root.exp.addv(pendingexp);
+				pendingruns = 0;
+				pendingexp.clear();
+			}
+		}
+
 		void reset(){
 			treelen.reset();
 			gamelen.reset();
@@ -187,6 +205,7 @@ public:
 	bool  ponder;     //think during opponents time?
 	int   numthreads; //number of player threads to run
 	u64   maxmem;     //maximum memory for the tree in bytes
+	uint  gcchunks;   //chunks of the tree to compact per pause while the search continues in between, 0 for all at once
 	bool  profile;    //count how long is spent in each stage of MCTS
 
 //tree traversal
@@ -203,6 +222,7 @@ public:
 	uint  visitexpand;//number of visits before expanding a node
 	bool  prunesymmetry; //prune symmetric children from the move list, useful for proving but likely not for playing
 	uint  gcsolved;   //garbage collect solved nodes or keep them in the tree, assuming they meet the required amount of work
+	uint  ttmin;      //the experience a transposition needs in the table before it's used as the prior of a new node
 
 //knowledge
 	int win_score;
@@ -214,10 +234,17 @@ public:
 	Node  root;
 	uword nodes;
 	int   gclimit; //the minimum experience needed to not be garbage collected
+	float gcremains; //stats of the garbage collection in progress, reported once compaction finishes
+	float gcmsec;
 
 	uint64_t runs, maxruns;
+	TimeManager timeman; //stops early or extends timed searches based on how settled the root is
+	double clock; //time left on the game clock for this move, searches are never extended past it, 0 for no clock
+	bool   flexible; //whether the clock keeps the time a move doesn't use, searches are only stopped early or extended if it does
 
 	CompactTree<Node> ctmem;
+	CompactTree<Node>::Disposer garbage; //the rest of the tree after a move, freed by the threads as they search
+	TransTable tt; //experience shared between transpositions, disabled unless given a size
 
 	AgentThreadPool<AgentMCTS> pool;
 
@@ -228,6 +255,8 @@ public:
 	void clear_mem() { };
 
 	void set_ponder(bool p);
+	void set_ttsize(uint64_t bytes);
+	std::string mem_stats();
 	void set_board(const Board & board, bool clear = true);
 
 	void move(const Move & m);
@@ -241,25 +270,46 @@ public:
 
 	bool done() {
 		//solved or finished runs
-		return (rootboard.outcome() >= Outcome::DRAW || root.outcome >= Outcome::DRAW || (maxruns > 0 && runs >= maxruns));
+		return (rootboard.outcome() >= Outcome::DRAW || root.outcome >= Outcome::DRAW || (maxruns > 0 && runs >= maxruns) ||
+		        (timeman.due() && check_time()));
+	}
+
+	void free_garbage() {
+		//only call when the threads are paused
+		nodes -= garbage.clear(ctmem);
 	}
 
 	bool need_gc() {
+		//continue an incremental compaction once the threads have had time to search
+		if(ctmem.compacting())
+			return ctmem.compact_due();
 		//out of memory, start garbage collection
 		return (ctmem.memalloced() >= maxmem);
 	}
 
 	void start_gc() {
-		Time starttime;
-		logerr("Starting player GC with limit " + to_str(gclimit) + " ... ");
-		uint64_t nodesbefore = nodes;
-		Board copy = rootboard;
-		garbage_collect(copy, & root);
-		Time gctime;
-		ctmem.compact(1.0, 0.75);
-		Time compacttime;
-		logerr(to_str(100.0*nodes/nodesbefore, 1) + " % of tree remains - " +
-			to_str((gctime - starttime)*1000, 0)  + " msec gc, " + to_str((compacttime - gctime)*1000, 0) + " msec compact\n");
+		free_garbage();
+		if(!ctmem.compacting()){
+			Time starttime;
+			logerr("Starting player GC with limit " + to_str(gclimit) + " ... ");
+			uint64_t nodesbefore = nodes;
+			Board copy = rootboard;
+			garbage_collect(copy, & root);
+			gcremains = 100.0*nodes/nodesbefore;
+			gcmsec = (Time() - starttime)*1000;
+			if(tt.enabled())
+				tt.gc(ttmin);
+			ctmem.compact_start(1.0, 0.75, gcchunks > 0);
+		}
+		if(!ctmem.compact_step(gcchunks))
+			return;
+
+		const DepthStats & pauses = ctmem.compact_pauses();
+		logerr(to_str(gcremains, 1) + " % of tree remains - " +
+			to_str(gcmsec, 0) + " msec gc, " + to_str(pauses.sumdepth/1000.0, 0) + " msec compact");
+		if(pauses.num > 1)
+			logerr(" in " + to_str(pauses.num) + " steps, avg " + to_str(pauses.avg()/1000, 1) + ", max " + to_str(pauses.maxdepth/1000.0, 1) + " msec");
+		logerr("\n");
 
 		if(ctmem.meminuse() >= maxmem/2)
 			gclimit = (int)(gclimit*1.3);
@@ -277,9 +327,13 @@ public:
 		load_sgf(sgf, rootboard, root);
 	}
 
+	bool save_tree(const std::string & filename, const std::string & info);
+	bool load_tree(const std::string & filename);
+
 protected:
 
 	void garbage_collect(Board & board, Node * node); //destroys the board, so pass in a copy
+	bool check_time();
 	bool do_backup(Node * node, Node * backup, Side to_play);
 	Move return_move(const Node * node, Side to_play, int verbose = 0) const;
 
@@ -12,17 +12,27 @@ namespace Morat {
 namespace Pentago {
 
 void AgentMCTS::AgentThread::iterate(){
-	INCR(agent->runs);
+	if(!agent->garbage.empty()){
+		uword freed = agent->garbage.step(arena, disposeblocks);
+		if(freed){
+			PLUS(agent->nodes, -freed);
+			if(agent->garbage.empty())
+				logerr("Freed " + to_str(agent->garbage.num_freed()) + " nodes of the old tree while searching\n");
+		}
+	}
+
 	if(agent->profile){
 		timestamps[0] = Time();
 		stage = 0;
 	}
 
 	movelist.reset(&(agent->rootboard));
-	agent->root.exp.addvloss();
 	Board copy = agent->rootboard;
 	walk_tree(copy, & agent->root, 0);
-	agent->root.exp.addv(movelist.getexp(~agent->rootboard.to_play()));
+	pendingexp.addloss(); //the root is the same for every run, so there's no need for a virtual loss
+	pendingexp += movelist.getexp(~agent->rootboard.to_play());
+	if(++pendingruns >= flushruns || (agent->maxruns > 0 && agent->runs + pendingruns >= agent->maxruns))
+		flush();
 
 	if(agent->profile){
 		times[0] += timestamps[1] - timestamps[0];
@@ -49,11 +59,14 @@ void AgentMCTS::AgentThread::walk_tree(Board & board, Node * node, int depth){
 					assert(false && "move failed");
 				}
 
+				hash_t hash = (agent->tt.enabled() ? board.full_hash() : 0);
 				child->exp.addvloss(); //balanced out after rollouts
 
 				walk_tree(board, child, depth+1);
 
 				child->exp.addv(movelist.getexp(to_play));
+				if(hash)
+					agent->tt.add(hash, movelist.getexp(to_play));
 				agent->do_backup(node, child, to_play);
 				return;
 			}
@@ -114,7 +127,7 @@ bool AgentMCTS::AgentThread::create_children(const Board & board, Node * node){
 		return false;
 
 	CompactTree<Node>::Children temp;
-	temp.alloc(board.moves_avail(), agent->ctmem);
+	temp.alloc(board.moves_avail(), arena);
 
 	Node * child = temp.begin(),
 	     * end   = temp.end();
@@ -132,13 +145,20 @@ bool AgentMCTS::AgentThread::create_children(const Board & board, Node * node){
 				node->proofdepth = 1;
 				node->bestmove = *move;
 				node->children.unlock();
-				temp.dealloc(agent->ctmem);
+				temp.dealloc(arena);
 				return true;
 			}
 		}
 
 		if(agent->knowledge)
 			add_knowledge(after, node, child);
+
+		//there's no rave to hold a prior, so use what a transposition learned as knowledge, which fades with experience
+		if(agent->tt.enabled()){
+			ExpPair exp;
+			if(agent->tt.find(after.full_hash(), exp) && exp.num() >= agent->ttmin)
+				child->know += (exp.avg() - 0.5f) * 100;
+		}
 		num_moves++;
 	}
 
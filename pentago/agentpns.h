@@ -4,12 +4,17 @@
 //A multi-threaded, tree based, proof number search solver.
 
 #include <string>
+#include <vector>
+#include <sys/types.h>
 
 #include "../lib/agentpool.h"
 #include "../lib/compacttree.h"
 #include "../lib/depthstats.h"
 #include "../lib/log.h"
+#include "../lib/pnstable.h"
 #include "../lib/string.h"
+#include "../lib/workcount.h"
+#include "../lib/xorshift.h"
 
 #include "agent.h"
 
@@ -24,20 +29,30 @@ class AgentPNS : public Agent {
 public:
 
 	struct Node {
-		static const uint16_t reflock = 1<<15;
+#ifdef PNS_COMPACT
+		//16 bytes along with 32bit handles for the children, at the cost of only knowing the work roughly and
+		//leaving 7 bits to count the threads in
+		typedef WorkCountLog8 Work;
+		typedef uint8_t  RefCount;
+#else
+		typedef WorkCount Work;
+		typedef uint16_t RefCount;
+#endif
+		static const RefCount reflock = (RefCount)1 << (sizeof(RefCount)*8 - 1);
+		static const unsigned int maxthreads = reflock - 1;
 		uint32_t phi, delta;
-		uint64_t work;
-		uint16_t refcount; //how many threads are down this node
+		Work     work;
+		RefCount refcount; //how many threads are down this node
 		Move move;
 		CompactTree<Node>::Children children;
 
-		Node() { }
+		Node() : refcount(0) { } //recycled memory may have any ref count, and a stray claim would hide the node forever
 		Node(int x, int y,   int v = 1)     : phi(v), delta(v), work(0), refcount(0), move(Move(x,y)) { }
 		Node(const Move & m, int v = 1)     : phi(v), delta(v), work(0), refcount(0), move(m)         { }
 		Node(int x, int y,   int p, int d)  : phi(p), delta(d), work(0), refcount(0), move(Move(x,y)) { }
 		Node(const Move & m, int p, int d)  : phi(p), delta(d), work(0), refcount(0), move(m)         { }
 
-		Node(const Node & n) { *this = n; }
+		Node(const Node & n) : refcount(0) { *this = n; } //the copy is a new node that no thread is in
 		Node & operator = (const Node & n){
 			if(this != & n){ //don't copy to self
 				//don't copy to a node that already has children
@@ -94,6 +109,22 @@ public:
 		void ref()  { PLUS(refcount, 1); }
 		void deref(){ PLUS(refcount, -1); }
 
+		//a claimed node is the root of a job that one thread searches alone, the others stay out of it
+		bool claimed() const { return (refcount & reflock); }
+		bool claim(){
+			RefCount r = refcount;
+			return !(r & reflock) && CAS(refcount, r, (RefCount)(r | reflock));
+		}
+		void unclaim(){ PLUS(refcount, (RefCount)(0 - reflock)); } //clears the bit, leaving the ref count
+		bool has_work() const {
+			if(children.empty())
+				return true;
+			for(Node * i = children.begin(); i != children.end(); i++)
+				if(!i->claimed() && !i->terminal())
+					return true;
+			return false;
+		}
+
 		unsigned int size() const {
 			unsigned int num = children.num();
 
@@ -125,11 +156,16 @@ public:
 	};
 
 	class AgentThread : public AgentThreadBase<AgentPNS> {
+		CompactTree<Node>::Arena arena; //thread local memory for creating children
+		static const unsigned int disposeblocks = 64; //blocks of the old tree to free per iteration while there are any
 	public:
 		DepthStats treelen;
 		uint64_t nodes_seen;
+		XORShift_uint32 rand; //for rounding the approximate work counts
+		std::vector<Node *> path; //from the root to the job being searched
+		std::vector<Board> boards; //the board at each node of the path
 
-		AgentThread(AgentThreadPool<AgentPNS> * p, AgentPNS * a) : AgentThreadBase<AgentPNS>(p, a) { }
+		AgentThread(AgentThreadPool<AgentPNS> * p, AgentPNS * a) : AgentThreadBase<AgentPNS>(p, a), arena(a->ctmem) { }
 
 		void reset(){
 			nodes_seen = 0;
@@ -137,6 +173,9 @@ public:
 
 		void iterate(); //handles each iteration
 
+		//claim a part of the tree no other thread is searching and search it
+		void job(const Board & board);
+
 		//basic proof number search building a tree
 		bool pns(const Board & board, Node * node, int depth, uint32_t tp, uint32_t td);
 
@@ -148,7 +187,18 @@ public:
 //memory management for PNS which uses a tree to store the nodes
 	uint64_t nodes, memlimit;
 	unsigned int gclimit;
+	unsigned int gcchunks; //chunks of the tree to compact per pause while the search continues in between, 0 for all at once
+	float gcmsec;
 	CompactTree<Node> ctmem;
+	CompactTree<Node>::Disposer garbage; //the rest of the tree after a move, freed by the threads as they search
+	PNSTable tt; //proof numbers shared between transpositions, disabled unless given a size
+
+//periodic checkpoints of the tree, written in the background by a forked copy of the process
+	std::string checkpoint;      //file to save the tree to while searching, empty for none
+	double      checkpoint_time; //seconds between checkpoints
+	std::string checkpoint_info; //the caller's info to save along with the tree
+	Time        next_checkpoint;
+	pid_t       checkpoint_pid;  //the process writing the last checkpoint, 0 if there isn't one
 
 	AgentThreadPool<AgentPNS> pool;
 
@@ -160,6 +210,8 @@ public:
 	bool  df; // go depth first?
 	float epsilon; //if depth first, how wide should the threshold be?
 	Side  ties;    //which player to assign ties to: 0 handle ties, 1 assign p1, 2 assign p2
+	bool  ttseed;  //start new nodes from the unproven numbers of a transposition, not just the proven ones
+	unsigned int jobdepth; //how deep threads claim the subtrees they search alone, 0 to share the tree using ref counts
 	int   numthreads;
 
 	Node root;
@@ -169,11 +221,17 @@ public:
 		df = true;
 		epsilon = 0.25;
 		ties = Side::NONE;
+		ttseed = true;
+		jobdepth = 2;
 		numthreads = 1;
 		pool.set_num_threads(numthreads);
 		gclimit = 5;
+		gcchunks = 0;
+		checkpoint_time = 3600;
+		checkpoint_pid = 0;
 
 		nodes = 0;
+		root = Node(0, 0, 1);
 		reset();
 
 		set_memlimit(1000*1024*1024);
@@ -182,7 +240,9 @@ public:
 	~AgentPNS(){
 		pool.pause();
 		pool.set_num_threads(0);
+		finish_checkpoint();
 
+		garbage.clear(ctmem);
 		root.dealloc(ctmem);
 		ctmem.compact();
 	}
@@ -206,8 +266,6 @@ public:
 		reset();
 
 
-		uint64_t nodesbefore = nodes;
-
 		Node child;
 
 		for(Node * i = root.children.begin(); i != root.children.end(); i++){
@@ -218,15 +276,11 @@ public:
 			}
 		}
 
-		nodes -= root.dealloc(ctmem);
+		//the threads free the rest of the tree as they search, so this doesn't have to wait for it
+		garbage.add(root);
 		root = child;
 		root.swap_tree(child);
 
-		if(nodesbefore > 0)
-			logerr(std::string("PNS Nodes before: ") + to_str(nodesbefore) + ", after: " + to_str(nodes) + ", saved " + to_str(100.0*nodes/nodesbefore, 1) + "% of the tree\n");
-
-		assert(nodes == root.size());
-
 		if(nodes == 0)
 			clear_mem();
 	}
@@ -237,10 +291,22 @@ public:
 
 	void clear_mem(){
 		reset();
+		garbage.clear(ctmem);
 		root.dealloc(ctmem);
 		ctmem.compact();
 		root = Node(0, 0, 1);
 		nodes = 0;
+		tt.clear();
+	}
+
+	void set_ttsize(uint64_t bytes){
+		pool.pause();
+		tt.resize(bytes);
+	}
+
+	std::string mem_stats(){
+		pool.pause();
+		return ctmem.mem_stats().to_s();
 	}
 
 	bool done() {
@@ -249,22 +315,41 @@ public:
 	}
 
 	bool need_gc() {
+		if(checkpoint_due())
+			return true;
+		//continue an incremental compaction once the threads have had time to search
+		if(ctmem.compacting())
+			return ctmem.compact_due();
 		//out of memory, start garbage collection
 		return (ctmem.memalloced() >= memlimit);
 	}
 
 	void start_gc() {
-		Time starttime;
-		logerr("Starting GC with limit " + to_str(gclimit) + " ... ");
+		if(checkpoint_due()){
+			start_checkpoint();
+			if(!ctmem.compacting() && ctmem.memalloced() < memlimit)
+				return;
+		}
+
+		nodes -= garbage.clear(ctmem);
+		if(!ctmem.compacting()){
+			Time starttime;
+			logerr("Starting GC with limit " + to_str(gclimit) + " ... ");
 
-		garbage_collect(& root);
+			garbage_collect(& root);
 
-		Time gctime;
-		ctmem.compact(1.0, 0.75);
+			gcmsec = (Time() - starttime)*1000;
+			ctmem.compact_start(1.0, 0.75, gcchunks > 0);
+		}
+		if(!ctmem.compact_step(gcchunks))
+			return;
 
-		Time compacttime;
+		const DepthStats & pauses = ctmem.compact_pauses();
 		logerr(to_str(100.0*ctmem.meminuse()/memlimit, 1) + " % of tree remains - " +
-			to_str((gctime - starttime)*1000, 0)  + " msec gc, " + to_str((compacttime - gctime)*1000, 0) + " msec compact\n");
+			to_str(gcmsec, 0) + " msec gc, " + to_str(pauses.sumdepth/1000.0, 0) + " msec compact");
+		if(pauses.num > 1)
+			logerr(" in " + to_str(pauses.num) + " steps, avg " + to_str(pauses.avg()/1000, 1) + ", max " + to_str(pauses.maxdepth/1000.0, 1) + " msec");
+		logerr("\n");
 
 		if(ctmem.meminuse() >= memlimit/2)
 			gclimit = (unsigned int)(gclimit*1.3);
@@ -293,9 +378,28 @@ public:
 		load_sgf(sgf, rootboard, root);
 	}
 
+	bool save_tree(const std::string & filename, const std::string & info);
+	bool load_tree(const std::string & filename);
+
+	//save a checkpoint to file every secs seconds while searching, an empty file turns them off
+	void set_checkpoint(const std::string & file, double secs){
+		pool.pause();
+		checkpoint = file;
+		checkpoint_time = secs;
+		next_checkpoint = Time() + checkpoint_time;
+	}
+	bool checkpoint_due() const {
+		return (!checkpoint.empty() && Time() >= next_checkpoint);
+	}
+	void start_checkpoint();
+	void finish_checkpoint();
+
 	static void test();
 
 private:
+	//the search state saved along with the tree, so a loaded tree continues like it was never stopped
+	std::string state_info() const;
+
 //remove all the nodes with little work to free up some memory
 	void garbage_collect(Node * node);
 	Move return_move(const Node * node, Side to_play, int verbose = 0) const;
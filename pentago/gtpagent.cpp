@@ -14,17 +14,51 @@ GTPResponse GTP::gtp_move_stats(vecstr args){
 	return GTPResponse(true, agent->move_stats(moves));
 }
 
+GTPResponse GTP::gtp_mem_stats(vecstr args){
+	return GTPResponse(true, agent->mem_stats());
+}
+
 GTPResponse GTP::gtp_solve(vecstr args){
+	double use_time = 0;
+	for(unsigned int i = 0; i < args.size(); i++){
+		if(args[i] == "--resume" && i+1 < args.size()){
+			//pick up a solve from its last checkpoint, and keep checkpointing to the same file
+			std::string file = args[++i];
+			std::string info;
+			if(CompactTreeHeader::read_info(file, info) && parse_dict(info, "\n", ": ")["agent"] == "pns" && !dynamic_cast<AgentPNS *>(agent))
+				gtp_pns(vecstr());
+
+			GTPResponse r = gtp_load_tree(vecstr(1, file));
+			if(!r.success)
+				return r;
+
+			AgentPNS * pns = dynamic_cast<AgentPNS *>(agent);
+			if(pns && pns->checkpoint.empty())
+				pns->set_checkpoint(file, pns->checkpoint_time);
+		}else{
+			use_time = from_str<double>(args[i]);
+		}
+	}
+
 	if(hist->outcome() >= 0)
 		return GTPResponse(true, "resign");
 
-	double use_time = (args.size() >= 1 ?
-			from_str<double>(args[0]) :
-			time_control.get_time(hist.len(), hist->moves_remain(), agent->gamelen()));
+	if(use_time == 0)
+		use_time = time_control.get_time(hist.len(), hist->moves_remain(), agent->gamelen());
 
 	if(verbose)
 		logerr("time remain: " + to_str(time_control.remain, 1) + ", time: " + to_str(use_time, 3) + ", sims: " + to_str(time_control.max_sims) + "\n");
 
+	AgentPNS * pns = dynamic_cast<AgentPNS *>(agent);
+	if(pns)
+		pns->checkpoint_info = tree_info();
+
+	AgentMCTS * mcts = dynamic_cast<AgentMCTS *>(agent);
+	if(mcts){
+		mcts->clock = time_control.remain + time_control.move;
+		mcts->flexible = time_control.flexible;
+	}
+
 	Time start;
 	agent->search(use_time, time_control.max_sims, verbose);
 	time_control.use(Time() - start);
@@ -53,6 +87,12 @@ GTPResponse GTP::gtp_genmove(vecstr args){
 	if(verbose)
 		logerr("time:        remain: " + to_str(time_control.remain, 1) + ", use: " + to_str(use_time, 3) + ", sims: " + to_str(time_control.max_sims) + "\n");
 
+	AgentMCTS * mcts = dynamic_cast<AgentMCTS *>(agent);
+	if(mcts){
+		mcts->clock = time_control.remain + time_control.move;
+		mcts->flexible = time_control.flexible;
+	}
+
 	Time start;
 	agent->search(use_time, time_control.max_sims, verbose);
 	time_control.use(Time() - start);
@@ -81,6 +121,7 @@ GTPResponse GTP::gtp_params(vecstr args){
 	if(dynamic_cast<AgentAB   *>(agent)) return gtp_ab_params(args);
 	if(dynamic_cast<AgentMCTS *>(agent)) return gtp_mcts_params(args);
 	if(dynamic_cast<AgentPNS  *>(agent)) return gtp_pns_params(args);
+	if(dynamic_cast<AgentDFPN *>(agent)) return gtp_dfpn_params(args);
 
 	return GTPResponse(false, "Unknown Agent type");
 }
@@ -122,7 +163,15 @@ GTPResponse GTP::gtp_mcts_params(vecstr args){
 #endif
 			"  -o --ponder      Continue to ponder during the opponents time      [" + to_str(mcts->ponder) + "]\n" +
 			"  -M --maxmem      Max memory in Mb to use for the tree              [" + to_str(mcts->maxmem/(1024*1024)) + "]\n" +
+			"     --chunksize   Size in Mb of the chunks the tree is allocated in [" + to_str(mcts->ctmem.chunk_size()/(1024*1024)) + "]\n" +
+			"     --hugepages   Huge pages for the tree: 0 off, 1 thp, 2 hugetlb  [" + to_str(mcts->ctmem.huge_pages()) + "]\n" +
+			"     --sizeclasses Round tree blocks up to size classes for reuse    [" + to_str(mcts->ctmem.size_classes()) + "]\n" +
+			"     --gcchunks    Chunks to compact per GC pause, 0 for all at once [" + to_str(mcts->gcchunks) + "]\n" +
+			"     --ttsize      Transposition table size in Mb, 0 to disable      [" + to_str(mcts->tt.memsize()/(1024*1024)) + "]\n" +
+			"     --ttmin       Table experience needed to use it as a prior      [" + to_str(mcts->ttmin) + "]\n" +
 			"     --profile     Output the time used by each phase of MCTS        [" + to_str(mcts->profile) + "]\n" +
+			"     --earlystop   Stop once the best move can't be overtaken        [" + to_str(mcts->timeman.earlystop) + "]\n" +
+			"     --extend      Search up to this multiple of the time if unsure  [" + to_str(mcts->timeman.extend) + "]\n" +
 			"Tree traversal:\n" +
 			"  -e --explore     Exploration rate for UCT                          [" + to_str(mcts->explore) + "]\n" +
 			"  -A --parexplore  Multiply the explore rate by parents experience   [" + to_str(mcts->parentexplore) + "]\n" +
@@ -153,8 +202,24 @@ GTPResponse GTP::gtp_mcts_params(vecstr args){
 			mcts->set_ponder(from_str<bool>(args[++i]));
 		}else if((arg == "--profile") && i+1 < args.size()){
 			mcts->profile = from_str<bool>(args[++i]);
+		}else if((               arg == "--earlystop") && i+1 < args.size()){
+			mcts->timeman.earlystop = from_str<bool>(args[++i]);
+		}else if((               arg == "--extend") && i+1 < args.size()){
+			mcts->timeman.extend = from_str<float>(args[++i]);
 		}else if((arg == "-M" || arg == "--maxmem") && i+1 < args.size()){
 			mcts->maxmem = from_str<uint64_t>(args[++i])*1024*1024;
+		}else if((               arg == "--chunksize") && i+1 < args.size()){
+			mcts->ctmem.set_chunk_size(from_str<uint64_t>(args[++i])*1024*1024);
+		}else if((               arg == "--hugepages") && i+1 < args.size()){
+			mcts->ctmem.set_huge_pages(from_str<int>(args[++i]));
+		}else if((               arg == "--sizeclasses") && i+1 < args.size()){
+			mcts->ctmem.set_size_classes(from_str<bool>(args[++i]));
+		}else if((               arg == "--gcchunks") && i+1 < args.size()){
+			mcts->gcchunks = from_str<uint>(args[++i]);
+		}else if((               arg == "--ttsize") && i+1 < args.size()){
+			mcts->set_ttsize(from_str<uint64_t>(args[++i])*1024*1024);
+		}else if((               arg == "--ttmin") && i+1 < args.size()){
+			mcts->ttmin = from_str<uint>(args[++i]);
 		}else if((arg == "-e" || arg == "--explore") && i+1 < args.size()){
 			mcts->explore = from_str<float>(args[++i]);
 		}else if((arg == "-A" || arg == "--parexplore") && i+1 < args.size()){
@@ -191,7 +256,16 @@ GTPResponse GTP::gtp_pns_params(vecstr args){
 		return GTPResponse(true, string("\n") +
 			"Update the pns solver settings, eg: pns_params -m 100 -s 0 -d 1 -e 0.25 -a 2 -l 0\n"
 			"  -m --memory   Memory limit in Mb                                       [" + to_str(pns->memlimit/(1024*1024)) + "]\n"
+			"     --chunksize Size in Mb of the chunks the tree is allocated in       [" + to_str(pns->ctmem.chunk_size()/(1024*1024)) + "]\n"
+			"     --hugepages Huge pages for the tree: 0 off, 1 thp, 2 hugetlb        [" + to_str(pns->ctmem.huge_pages()) + "]\n"
+			"     --sizeclasses Round tree blocks up to size classes for reuse        [" + to_str(pns->ctmem.size_classes()) + "]\n"
+			"     --gcchunks Chunks to compact per GC pause, 0 for all at once        [" + to_str(pns->gcchunks) + "]\n"
+			"     --ttsize   Transposition table size in Mb, 0 to disable             [" + to_str(pns->tt.memsize()/(1024*1024)) + "]\n"
+			"     --ttseed   Start new nodes from unproven transpositions too         [" + to_str(pns->ttseed) + "]\n"
+			"     --checkpoint Save the tree to this file while solving, - for none   [" + (pns->checkpoint.empty() ? "-" : pns->checkpoint) + "]\n"
+			"     --checkpointtime Seconds between checkpoints                        [" + to_str(pns->checkpoint_time) + "]\n"
 			"  -t --threads  How many threads to run                                  [" + to_str(pns->numthreads) + "]\n"
+			"     --jobdepth How deep threads claim subtrees to search alone, 0 for none [" + to_str(pns->jobdepth) + "]\n"
 			"  -s --ties     Which side to assign ties to, 0 = handle, 1 = p1, 2 = p2 [" + to_str(pns->ties.to_i()) + "]\n"
 			"  -d --df       Use depth-first thresholds                               [" + to_str(pns->df) + "]\n"
 			"  -e --epsilon  How big should the threshold be                          [" + to_str(pns->epsilon) + "]\n"
@@ -203,12 +277,34 @@ GTPResponse GTP::gtp_pns_params(vecstr args){
 		string arg = args[i];
 
 		if((arg == "-t" || arg == "--threads") && i+1 < args.size()){
-			pns->numthreads = from_str<int>(args[++i]);
+			int threads = from_str<int>(args[++i]);
+			if(threads > (int)AgentPNS::Node::maxthreads)
+				return GTPResponse(false, "Can't run more than " + to_str((unsigned int)AgentPNS::Node::maxthreads) + " threads");
+			pns->numthreads = threads;
 			pns->pool.set_num_threads(pns->numthreads);
 		}else if((arg == "-m" || arg == "--memory") && i+1 < args.size()){
 			uint64_t mem = from_str<uint64_t>(args[++i]);
 			if(mem < 1) return GTPResponse(false, "Memory can't be less than 1mb");
 			pns->set_memlimit(mem*1024*1024);
+		}else if((            arg == "--chunksize") && i+1 < args.size()){
+			pns->ctmem.set_chunk_size(from_str<uint64_t>(args[++i])*1024*1024);
+		}else if((            arg == "--hugepages") && i+1 < args.size()){
+			pns->ctmem.set_huge_pages(from_str<int>(args[++i]));
+		}else if((            arg == "--sizeclasses") && i+1 < args.size()){
+			pns->ctmem.set_size_classes(from_str<bool>(args[++i]));
+		}else if((            arg == "--gcchunks") && i+1 < args.size()){
+			pns->gcchunks = from_str<unsigned int>(args[++i]);
+		}else if((            arg == "--ttsize") && i+1 < args.size()){
+			pns->set_ttsize(from_str<uint64_t>(args[++i])*1024*1024);
+		}else if((            arg == "--ttseed") && i+1 < args.size()){
+			pns->ttseed = from_str<bool>(args[++i]);
+		}else if((            arg == "--jobdepth") && i+1 < args.size()){
+			pns->jobdepth = from_str<unsigned int>(args[++i]);
+		}else if((            arg == "--checkpoint") && i+1 < args.size()){
+			string file = args[++i];
+			pns->set_checkpoint((file == "-" ? "" : file), pns->checkpoint_time);
+		}else if((            arg == "--checkpointtime") && i+1 < args.size()){
+			pns->set_checkpoint(pns->checkpoint, from_str<double>(args[++i]));
 		}else if((arg == "-s" || arg == "--ties") && i+1 < args.size()){
 			pns->ties = Side(from_str<int8_t>(args[++i]));
 			pns->clear_mem();
@@ -226,5 +322,40 @@ GTPResponse GTP::gtp_pns_params(vecstr args){
 	return GTPResponse(true, errs);
 }
 
+GTPResponse GTP::gtp_dfpn_params(vecstr args){
+	AgentDFPN * dfpn =  dynamic_cast<AgentDFPN *>(agent);
+
+	if(args.size() == 0)
+		return GTPResponse(true, string("\n") +
+			"Update the dfpn solver settings, eg: dfpn_params -m 100 -s 0 -e 0.25 -a 2\n"
+			"  -m --memory   Size of the table in Mb, the only memory it uses         [" + to_str(dfpn->memlimit/(1024*1024)) + "]\n"
+			"  -s --ties     Which side to assign ties to, 0 = handle, 1 = p1, 2 = p2 [" + to_str(dfpn->ties.to_i()) + "]\n"
+			"  -e --epsilon  How big should the threshold be                          [" + to_str(dfpn->epsilon) + "]\n"
+			"  -a --abdepth  Run an alpha-beta search of this size at each leaf       [" + to_str(dfpn->ab) + "]\n"
+			);
+
+	string errs;
+	for(unsigned int i = 0; i < args.size(); i++) {
+		string arg = args[i];
+
+		if((arg == "-m" || arg == "--memory") && i+1 < args.size()){
+			uint64_t mem = from_str<uint64_t>(args[++i]);
+			if(mem < 1) return GTPResponse(false, "Memory can't be less than 1mb");
+			dfpn->set_memlimit(mem*1024*1024);
+		}else if((arg == "-s" || arg == "--ties") && i+1 < args.size()){
+			dfpn->ties = Side(from_str<int8_t>(args[++i]));
+			dfpn->clear_mem();
+		}else if((arg == "-e" || arg == "--epsilon") && i+1 < args.size()){
+			dfpn->epsilon = from_str<float>(args[++i]);
+		}else if((arg == "-a" || arg == "--abdepth") && i+1 < args.size()){
+			dfpn->ab = from_str<int>(args[++i]);
+		}else{
+			return GTPResponse(false, "Missing or unknown parameter");
+		}
+	}
+
+	return GTPResponse(true, errs);
+}
+
 }; // namespace Pentago
 }; // namespace Morat
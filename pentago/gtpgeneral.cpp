@@ -1,6 +1,7 @@
 
 #include <fstream>
 
+#include "../lib/compacttree.h"
 #include "../lib/sgf.h"
 
 #include "gtp.h"
@@ -23,6 +24,12 @@ GTPResponse GTP::gtp_pns(vecstr args){
 	agent->set_board(*hist);
 	return GTPResponse(true);
 }
+GTPResponse GTP::gtp_dfpn(vecstr args){
+	delete agent;
+	agent = new AgentDFPN();
+	agent->set_board(*hist);
+	return GTPResponse(true);
+}
 GTPResponse GTP::gtp_ab(vecstr args){
 	delete agent;
 	agent = new AgentAB();
@@ -247,5 +254,58 @@ GTPResponse GTP::gtp_load_sgf(vecstr args){
 	return true;
 }
 
+//the game and position a tree is for, so load_tree can go back to it
+std::string GTP::tree_info() const {
+	vecstr moves;
+	for(auto m : hist)
+		moves.push_back(m.to_s());
+
+	return std::string("game: ") + Board::name + "\n" +
+	       "size: " + hist->size() + "\n" +
+	       "moves: " + implode(moves, " ") + "\n";
+}
+
+GTPResponse GTP::gtp_save_tree(vecstr args){
+	if(args.size() == 0)
+		return GTPResponse(true, "save_tree <filename>");
+
+	std::ifstream infile(args[0].c_str());
+
+	if(infile) {
+		infile.close();
+		return GTPResponse(false, "File " + args[0] + " already exists");
+	}
+
+	if(!agent->save_tree(args[0], tree_info()))
+		return GTPResponse(false, "Saving the tree to " + args[0] + " failed");
+	return true;
+}
+
+GTPResponse GTP::gtp_load_tree(vecstr args){
+	if(args.size() == 0)
+		return GTPResponse(true, "load_tree <filename>");
+
+	std::string info;
+	if(!CompactTreeHeader::read_info(args[0], info))
+		return GTPResponse(false, "File " + args[0] + " isn't a tree generated by save_tree");
+
+	dictstr dict = parse_dict(info, "\n", ": ");
+	if(dict["game"] != Board::name)
+		return GTPResponse(false, "File is for the wrong game: " + dict["game"]);
+
+	//the tree is for the position it was saved in, so go back to that
+	hist = History(Board(dict["size"]));
+	set_board();
+	time_control.new_game();
+
+	for(auto m : explode(dict["moves"], " "))
+		if(m.size())
+			move(Move(m));
+
+	if(!agent->load_tree(args[0]))
+		return GTPResponse(false, "File " + args[0] + " was saved by another agent or a different build");
+	return true;
+}
+
 }; // namespace Pentago
 }; // namespace Morat
@@ -1,4 +1,6 @@
 
+#include <sys/wait.h>
+
 #include "../lib/alarm.h"
 #include "../lib/log.h"
 #include "../lib/time.h"
@@ -14,7 +16,7 @@ std::string AgentPNS::Node::to_s() const {
 	       ", move " + move.to_s() +
 	       ", phi " + to_str(phi) +
 	       ", delta " + to_str(delta) +
-	       ", work " + to_str(work) +
+	       ", work " + to_str((uint64_t)work) +
 	       ", children " + to_str(children.num());
 }
 
@@ -84,10 +86,100 @@ void AgentPNS::search(double time, uint64_t maxiters, int verbose){
 }
 
 void AgentPNS::AgentThread::iterate(){
-	pns(agent->rootboard, &agent->root, 0, INF32/2, INF32/2);
+	if(!agent->garbage.empty()){
+		uint64_t freed = agent->garbage.step(arena, disposeblocks);
+		if(freed){
+			PLUS(agent->nodes, -freed);
+			if(agent->garbage.empty())
+				logerr("PNS Freed " + to_str(agent->garbage.num_freed()) + " nodes of the old tree while searching\n");
+		}
+	}
+
+	Board board = agent->rootboard;
+	board.set_journal(&journal);
+	if(agent->jobdepth && !agent->root.children.empty())
+		job(board);
+	else
+		pns(board, &agent->root, 0, INF32/2, INF32/2);
+	assert(journal.depth() == 0);
 }
 
-bool AgentPNS::AgentThread::pns(const Board & board, Node * node, int depth, uint32_t tp, uint32_t td){
+//Job level parallelism: walk down the most proving path to a node at least jobdepth deep that no other thread is
+//searching, claim it and search it alone with the thresholds it would get in a depth first search. When every child
+//of a node on the way is claimed, go into the most proving of them anyway and claim a node under it, taking over that
+//part of the other thread's job, which it then skips. Each thread works on its own subtree, instead of them all
+//following each other down the same path, which leaves little to do for each one once there are many of them.
+void AgentPNS::AgentThread::job(Board & board){
+	path.clear();
+	path.push_back(& agent->root);
+	uint32_t tp = INF32/2, td = INF32/2;
+	bool claimed = false;
+
+	while(true){
+		Node * node = path.back();
+		if(node->terminal() || node->children.empty())
+			break;
+
+		//the best and second best children to search, those not claimed by another thread first
+		Node * child = NULL, * child2 = NULL;
+		bool free = false;
+		for(auto & i : node->children){
+			if(i.terminal() || (free && i.claimed()))
+				continue;
+			if(!free && !i.claimed()){
+				free = true;
+				child = child2 = NULL;
+			}
+			if(!child || i.delta <= child->delta){
+				child2 = child;
+				child = & i;
+			}else if(!child2 || i.delta < child2->delta){
+				child2 = & i;
+			}
+		}
+		if(!child)
+			break;
+		if(!child2)
+			child2 = child;
+
+		//the depth first thresholds, always leaving room to do some work
+		uint32_t tpc = (td > node->delta ? std::min(INF32/2, td + child->phi - node->delta) : 0);
+		uint32_t tdc = std::min(tp, (uint32_t)(child2->delta*(1.0 + agent->epsilon) + 1));
+		tp = std::max(tpc, child->phi + 1);
+		td = std::max(tdc, child->delta + 1);
+
+		board.move(child->move);
+		path.push_back(child);
+
+		//a job needs something left in it to search, otherwise go on down to take over part of it
+		if(free && (path.size() > agent->jobdepth || child->children.empty()) && child->has_work()){
+			claimed = child->claim();
+			break;
+		}
+	}
+
+	Node * node = path.back();
+	if(claimed){
+		uint64_t seen_before = nodes_seen;
+		pns(board, node, path.size() - 1, tp, td);
+		node->unclaim();
+		for(unsigned int i = 1; i < path.size(); i++)
+			path[i]->work.add(nodes_seen - seen_before, rand());
+	}else if(!node->children.empty()){
+		//nothing left to claim under it, but it may have missed an update from another thread that proved a child
+		updatePDnum(node);
+	}
+
+	//back up the path, updating the numbers with what the job found
+	for(int i = path.size() - 2; i >= 0; i--){
+		board.undo();
+		updatePDnum(path[i]);
+		if(agent->tt.enabled())
+			agent->tt.store(board.gethash(), path[i]->phi, path[i]->delta);
+	}
+}
+
+bool AgentPNS::AgentThread::pns(Board & board, Node * node, int depth, uint32_t tp, uint32_t td){
 	// no children, create them
 	if(node->children.empty()){
 		treelen.add(depth);
@@ -95,6 +187,14 @@ bool AgentPNS::AgentThread::pns(const Board & board, Node * node, int depth, uin
 		if(node->terminal())
 			return true;
 
+		//a transposition may have been proven since this node was created
+		uint32_t phi, delta;
+		if(agent->tt.enabled() && agent->tt.find(board.gethash(), phi, delta) && (phi == 0 || delta == 0)){
+			node->phi = phi;
+			node->delta = delta;
+			return true;
+		}
+
 		if(agent->need_gc())
 			return false;
 
@@ -102,7 +202,7 @@ bool AgentPNS::AgentThread::pns(const Board & board, Node * node, int depth, uin
 			return false;
 
 		CompactTree<Node>::Children temp;
-		temp.alloc(board.moves_avail(), agent->ctmem);
+		temp.alloc(board.moves_avail(), arena);
 
 		if(agent->lbdist)
 			dists.run(&board);
@@ -113,11 +213,11 @@ bool AgentPNS::AgentThread::pns(const Board & board, Node * node, int depth, uin
 			Outcome outcome;
 
 			if(agent->ab){
-				Board next = board;
-				next.move(move);
+				board.move(move);
 
 				pd = 0;
-				outcome = (agent->ab == 1 ? solve1ply(next, pd) : solve2ply(next, pd));
+				outcome = (agent->ab == 1 ? solve1ply(board, pd) : solve2ply(board, pd));
+				board.undo();
 			}else{
 				pd = 1;
 				outcome = board.test_outcome(move);
@@ -127,6 +227,13 @@ bool AgentPNS::AgentThread::pns(const Board & board, Node * node, int depth, uin
 				pd = dists.get(move);
 
 			temp[i] = Node(move).outcome(outcome, board.to_play(), agent->ties, pd);
+
+			//start where a transposition left off
+			if(outcome == Outcome::UNKNOWN && agent->tt.enabled() &&
+			   agent->tt.find(board.test_hash(move), phi, delta) && (agent->ttseed || phi == 0 || delta == 0)){
+				temp[i].phi = phi;
+				temp[i].delta = delta;
+			}
 			i++;
 		}
 		nodes_seen += i;
@@ -137,19 +244,31 @@ bool AgentPNS::AgentThread::pns(const Board & board, Node * node, int depth, uin
 		assert(temp.unlock());
 
 		updatePDnum(node);
+		if(agent->tt.enabled())
+			agent->tt.store(board.gethash(), node->phi, node->delta);
 
 		return (agent->nodes_seen >= agent->max_nodes_seen);
 	}
 
-	bool mem;
+	bool mem = true;
 	do{
 		Node * child = node->children.begin(), // the best move to explore
-		     * child2 = node->children.begin();// second best for thresholds
+		     * end = node->children.end();
+
+		//skip the parts of this job another thread has taken over
+		while(child != end && child->claimed())
+			child++;
+		if(child == end)
+			break;
+
+		Node * child2 = child; // second best for thresholds
 
 		uint32_t tpc, tdc; // the thresholds
 
 		if(agent->df){
 			for(auto & i : node->children){
+				if(i.claimed())
+					continue;
 				if(i.refdelta() <= child->refdelta()){
 					child2 = child;
 					child = & i;
@@ -163,23 +282,26 @@ bool AgentPNS::AgentThread::pns(const Board & board, Node * node, int depth, uin
 		}else{
 			tpc = tdc = 0;
 			for(auto & i : node->children)
-				if(child->refdelta() > i.refdelta())
+				if(!i.claimed() && child->refdelta() > i.refdelta())
 					child = & i;
 		}
 
-		Board next = board;
-		next.move(child->move);
+		board.move(child->move);
 
 		child->ref();
 		uint64_t seen_before = nodes_seen;
-		mem = pns(next, child, depth + 1, tpc, tdc);
+		mem = pns(board, child, depth + 1, tpc, tdc);
 		child->deref();
-		PLUS(child->work, nodes_seen - seen_before);
+		board.undo();
+		child->work.add(nodes_seen - seen_before, rand());
 
 		if(updatePDnum(node) && !agent->df)
 			break;
 
-	}while(!agent->timeout && mem && (!agent->df || (node->phi < tp && node->delta < td)));
+	}while(!agent->timeout && mem && !agent->done() && (!agent->df || (node->phi < tp && node->delta < td)));
+
+	if(agent->tt.enabled())
+		agent->tt.store(board.gethash(), node->phi, node->delta);
 
 	return mem;
 }
@@ -363,5 +485,93 @@ void AgentPNS::load_sgf(SGFParser<Move> & sgf, const Board & board, Node & node)
 	}
 }
 
+bool AgentPNS::save_tree(const std::string & filename, const std::string & info) {
+	pool.pause();
+
+	Time start;
+	bool ok = ctmem.save(filename, root, state_info() + info);
+	if(ok)
+		logerr("Saved the tree in " + to_str((Time() - start)*1000, 0) + " msec\n");
+	return ok;
+}
+
+bool AgentPNS::load_tree(const std::string & filename) {
+	std::string info;
+	if(!CompactTreeHeader::read_info(filename, info))
+		return false;
+	dictstr dict = parse_dict(info, "\n", ": ");
+	if(dict["agent"] != "pns")
+		return false;
+
+	pool.pause();
+	clear_mem();
+
+	Time start;
+	uint64_t loaded = 0;
+	bool ok = ctmem.load(filename, root, loaded);
+	if(ok){
+		nodes = loaded;
+
+		//older files don't have the search state, so keep the current settings for whatever is missing
+		if(dict.count("nodes_seen")) nodes_seen = from_str<uint64_t>(dict["nodes_seen"]);
+		if(dict.count("memlimit"))   memlimit = from_str<uint64_t>(dict["memlimit"]);
+		if(dict.count("gclimit"))    gclimit = from_str<unsigned int>(dict["gclimit"]);
+		if(dict.count("ab"))         ab = from_str<int>(dict["ab"]);
+		if(dict.count("df"))         df = from_str<bool>(dict["df"]);
+		if(dict.count("epsilon"))    epsilon = from_str<float>(dict["epsilon"]);
+		if(dict.count("ties"))       ties = Side(from_str<int>(dict["ties"]));
+		if(dict.count("lbdist"))     lbdist = from_str<bool>(dict["lbdist"]);
+		if(dict.count("ttseed"))     ttseed = from_str<bool>(dict["ttseed"]);
+		if(dict.count("jobdepth"))   jobdepth = from_str<unsigned int>(dict["jobdepth"]);
+
+		logerr("Loaded " + to_str(loaded) + " nodes in " + to_str((Time() - start)*1000, 0) + " msec\n");
+	}
+	return ok;
+}
+
+std::string AgentPNS::state_info() const {
+	return "agent: pns\n"
+	       "nodes_seen: " + to_str(nodes_seen) + "\n" +
+	       "memlimit: " + to_str(memlimit) + "\n" +
+	       "gclimit: " + to_str(gclimit) + "\n" +
+	       "ab: " + to_str(ab) + "\n" +
+	       "df: " + to_str(df) + "\n" +
+	       "epsilon: " + to_str(epsilon) + "\n" +
+	       "ties: " + to_str(ties.to_i()) + "\n" +
+	       "lbdist: " + to_str(lbdist) + "\n" +
+	       "ttseed: " + to_str(ttseed) + "\n" +
+	       "jobdepth: " + to_str(jobdepth) + "\n";
+}
+
+//called by start_gc, so the other threads are waiting and the tree stays still while it forks
+void AgentPNS::start_checkpoint() {
+	next_checkpoint = Time() + checkpoint_time;
+
+	//a slow disk may still be writing the last one, so skip this one rather than have two going at once
+	if(checkpoint_pid > 0){
+		if(waitpid(checkpoint_pid, NULL, WNOHANG) == 0){
+			logerr("Checkpoint: still writing the last one, skipping this one\n");
+			return;
+		}
+		checkpoint_pid = 0;
+	}
+
+	Time start;
+	pid_t pid = ctmem.save_background(checkpoint, root, state_info() + checkpoint_info);
+	if(pid < 0){
+		logerr("Checkpoint: fork failed\n");
+		return;
+	}
+	checkpoint_pid = pid;
+	logerr("Checkpoint: paused " + to_str((Time() - start)*1000, 1) + " msec to start saving " + to_str(nodes) + " nodes\n");
+}
+
+//wait for the last checkpoint to be written
+void AgentPNS::finish_checkpoint() {
+	if(checkpoint_pid > 0)
+		waitpid(checkpoint_pid, NULL, 0);
+	checkpoint_pid = 0;
+}
+
 }; // namespace Rex
 }; // namespace Morat
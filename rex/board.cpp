@@ -1,4 +1,6 @@
 
+#include "../lib/thread.h"
+
 #include "board.h"
 
 namespace Morat {
@@ -94,9 +96,15 @@ int Board::edges(int x, int y) const {
 	       (x == sizem1_ ? 8 : 0);
 }
 
-std::shared_ptr<MoveValid> Board::gen_neighbor_list() const {
-	std::shared_ptr<MoveValid> list(new MoveValid[vec_size()*18]);
-	MoveValid * a = list.get();
+//one list per board size, built the first time a board of that size is made and shared by all of them after that,
+//so copying a board never has to allocate or reference count
+const MoveValid * Board::gen_neighbor_list() const {
+	static MoveValid * lists[max_size + 1] = {};
+	if(lists[size_])
+		return lists[size_];
+
+	MoveValid * list = new MoveValid[vec_size()*18];
+	MoveValid * a = list;
 	for(int y = 0; y < size_; y++){
 		for(int x = 0; x < size_; x++){
 			Move pos(x,y);
@@ -109,6 +117,35 @@ std::shared_ptr<MoveValid> Board::gen_neighbor_list() const {
 		}
 	}
 
+	//another thread may have built it at the same time, only keep one of them
+	if(!CAS(lists[size_], (MoveValid *)NULL, list)){
+		delete[] list;
+		list = lists[size_];
+	}
+	return list;
+}
+
+//the masks the flood fills need, shared by all boards of this size like the neighbor list: the cells not in the
+//first column, the cells not in the last column, then the edges in the same order as the edge bits
+const Board::Bits * Board::gen_bit_masks() const {
+	static Bits * lists[max_size + 1] = {};
+	if(lists[size_])
+		return lists[size_];
+
+	int s = size_;
+	Bits * list = new Bits[6]{
+		Bits::cells(s, [=](int x, int y){ return x != 0; }),
+		Bits::cells(s, [=](int x, int y){ return x != s - 1; }),
+		Bits::cells(s, [=](int x, int y){ return y == 0; }),
+		Bits::cells(s, [=](int x, int y){ return y == s - 1; }),
+		Bits::cells(s, [=](int x, int y){ return x == 0; }),
+		Bits::cells(s, [=](int x, int y){ return x == s - 1; }),
+	};
+
+	if(!CAS(lists[size_], (Bits *)NULL, list)){
+		delete[] list;
+		list = lists[size_];
+	}
 	return list;
 }
 
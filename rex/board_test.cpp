@@ -1,5 +1,6 @@
 
 #include "../lib/catch.hpp"
+#include "../lib/xorshift.h"
 
 #include "board.h"
 
@@ -228,3 +229,70 @@ TEST_CASE("Rex::Board size 7", "[rex][board]") {
 		 Outcome::P1);
 	}
 }
+
+//play random moves, taking some back along the way, and check that each undo gives back exactly the board from
+//before the move
+void test_undo(Board b) {
+	BoardJournal<Board::Cell> journal;
+	b.set_journal(&journal);
+
+	XORShift_uint32 rand(42);
+	std::vector<Board> before;
+	for(int i = 0; i < 1000; i++) {
+		if(!before.empty() && (b.outcome() != Outcome::UNKNOWN || rand() % 3 == 0)) {
+			b.undo();
+			const Board & o = before.back();
+			CAPTURE(o);
+			REQUIRE(b.to_s(false) == o.to_s(false));
+			REQUIRE(b.gethash() == o.gethash());
+			REQUIRE(b.to_play() == o.to_play());
+			REQUIRE(b.moves_made() == o.moves_made());
+			REQUIRE(b.outcome() == o.outcome());
+			REQUIRE(b.flood_outcome() == o.flood_outcome());
+			for(auto m : o) // the groups are back as they were too
+				REQUIRE(b.test_outcome(m) == o.test_outcome(m));
+			before.pop_back();
+		} else {
+			std::vector<Move> moves;
+			for(auto m : b)
+				moves.push_back(m);
+			before.push_back(b);
+			REQUIRE(b.move(moves[rand() % moves.size()]));
+		}
+	}
+	REQUIRE(journal.depth() == before.size());
+}
+
+TEST_CASE("Rex::Board undo", "[rex][board]") {
+	test_undo(Board("7"));
+}
+
+//play random games to the end, checking that the flood fill agrees with the groups after every move, then fill the
+//board with the same moves and check the full board has the same winner
+void test_fill(Board start) {
+	XORShift_uint32 rand(42);
+	for(int game = 0; game < 100; game++) {
+		std::vector<Move> moves;
+		for(auto m : start)
+			moves.push_back(m);
+		for(int i = moves.size() - 1; i > 0; i--)
+			std::swap(moves[i], moves[rand() % (i + 1)]);
+
+		Board b = start, f = start;
+		int wrong = 0;
+		for(auto m : moves) {
+			if(b.outcome() == Outcome::UNKNOWN)
+				wrong += (!b.move(m) || b.flood_outcome() != b.outcome());
+			f.fill(m);
+		}
+		CAPTURE(f);
+		REQUIRE(wrong == 0);
+		REQUIRE(b.outcome() != Outcome::UNKNOWN);
+		REQUIRE(f.finish_fill() == b.outcome());
+	}
+}
+
+TEST_CASE("Rex::Board fill", "[rex][board]") {
+	test_fill(Board("7"));
+	test_fill(Board("13"));
+}
@@ -27,6 +27,7 @@ public:
 	virtual void move(const Move & m) = 0;
 	virtual void set_memlimit(uint64_t lim) = 0; // in bytes
 	virtual void clear_mem() = 0;
+	virtual std::string mem_stats() = 0; // breakdown of the memory used by the tree
 
 	        vecmove get_pv() const { return get_pv(vecmove()); }
 	virtual vecmove get_pv(const vecmove& moves) const = 0;
@@ -38,6 +39,10 @@ public:
 
 	virtual void gen_sgf(SGFPrinter<Move> & sgf, int limit) const = 0;
 	virtual void load_sgf(SGFParser<Move> & sgf) = 0;
+
+	//save the tree in a binary file that load_tree maps back in, along with an info string for the caller
+	virtual bool save_tree(const std::string & filename, const std::string & info) = 0;
+	virtual bool load_tree(const std::string & filename) = 0;
         std::string root_outcome = "";
 
 protected:
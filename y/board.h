@@ -4,14 +4,17 @@
 #include <algorithm>
 #include <cassert>
 #include <cstdio>
+#include <cstring>
 #include <functional>
 #include <memory>
 #include <ostream>
 #include <string>
 #include <vector>
 
+#include "../lib/bitboard_hex.h"
 #include "../lib/bitcount.h"
 #include "../lib/board_grid_hex.h"
+#include "../lib/board_journal.h"
 #include "../lib/board_shape_triangle.h"
 #include "../lib/hashset.h"
 #include "../lib/move.h"
@@ -41,6 +44,8 @@ public:
 
 	static const int pattern_cells = 18;
 
+	typedef BitboardHex<max_vec_size> Bits;
+
 	struct Cell {
 		Side     piece;   //who controls this cell, 0 for none, 1,2 for players
 		uint16_t size;    //size of this group of cells
@@ -69,24 +74,44 @@ private:
         Side first_move = Side::NONE;
 	Outcome outcome_;
 
-	std::vector<Cell> cells_;
 	Zobrist<6> hash;
-	std::shared_ptr<MoveValid> neighbor_list_;
+	const MoveValid * neighbor_list_; //shared by all boards of this size
+	const Bits * bit_masks_;          //shared by all boards of this size, see gen_bit_masks
+	BoardJournal<Cell> * journal_;    //saves what each move changes so it can be undone, see set_journal
+
+	//the pieces of each side, indexed by side-1, so the winner can be found with a flood fill instead of the groups.
+	//Undo unsets the last move, so these aren't saved by the journal
+	Bits stones_[2];
+
+	//fixed size so copies are a flat memcpy without allocating, only the first vec_size() are used. It must stay the
+	//last member since copies stop at the end of the cells in use. It's in a union so the unused ones aren't
+	//constructed for each copy either
+	union {
+		Cell cells_[max_vec_size];
+	};
 
 public:
 	Board() = delete;
-	explicit Board(std::string s) {
+	explicit Board(std::string s) : journal_(NULL) {
 		assert(size(s));
 	}
 
+	Board(const Board & o) { *this = o; }
+	Board & operator = (const Board & o) {
+		//all the members are plain data, so copy everything up to the end of the cells in use
+		memcpy((void *)this, (const void *)&o, (const char *)(o.cells_ + o.vec_size()) - (const char *)&o);
+		journal_ = NULL; //a copy starts without one
+		return *this;
+	}
+
 	bool size(std::string s) {
 		if (!valid_size(s))
 			return false;
 		size_ = from_str<int>(s);
 		sizem1_ = size_ - 1;
 		neighbor_list_ = gen_neighbor_list();
+		bit_masks_ = gen_bit_masks();
 		num_cells_ = vec_size() - (size_ * sizem1_ / 2);
-		cells_.resize(vec_size());
 		clear();
 		return true;
 	}
@@ -102,6 +127,8 @@ public:
 		}
 		outcome_ = Outcome::UNKNOWN;
 		hash.clear();
+		stones_[0].clear();
+		stones_[1].clear();
 
 		for(int y = 0; y < size_; y++){
 			for(int x = 0; x < size_; x++){
@@ -139,7 +166,7 @@ public:
 		return (min_size <= size && size <= max_size);
 	}
 
-	int mem_size() const { return sizeof(Board) + sizeof(Cell)*vec_size(); }
+	int mem_size() const { return sizeof(Board); }
 	int vec_size() const { return size_*size_; }
 	int num_cells() const { return num_cells_; }
 
@@ -271,6 +298,19 @@ public:
 		return m;
 	}
 
+	//while a journal is set, moves can be taken back with undo in the reverse order they were made, which is much
+	//cheaper than copying the board for each move when searching deep in a tree
+	void set_journal(BoardJournal<Cell> * journal) { journal_ = journal; }
+
+	//take back the last move, only valid for moves that succeeded while the journal was set
+	void undo() {
+		assert(journal_ && journal_->depth() > 0);
+		MoveValid pos = move_valid(last_move_);
+		stones_[get(pos).to_i() - 1].unset(pos.xy);
+		clear_pattern(pos);
+		journal_->undo(this, cells_);
+	}
+
 	bool move(const Move & pos, bool checkwin = true, bool permanent = true) {
 		return move(MoveValid(pos, xy(pos)), checkwin, permanent);
 	}
@@ -280,15 +320,20 @@ public:
 		if(!valid_move(pos))
 			return false;
 
+		if(journal_)
+			journal_->begin(this, (const char *)stones_ - (const char *)this);
+
 		last_move_ = pos;
 		num_moves_++;
 
+		save(pos.xy);
 		Cell& cell = cells_[pos.xy];
 		cell.piece = to_play_;
 		cell.perm = permanent;
 
 		update_hash(pos, to_play_); //depends on num_moves_
 		update_pattern(pos, to_play_);
+		stones_[to_play_.to_i() - 1].set(pos.xy);
 
 		// join the groups for win detection
 		auto it = neighbors_small(pos);
@@ -311,6 +356,49 @@ public:
 		return true;
 	}
 
+	//whether side has a group touching all three edges, found with flood fills. The groups on the first edge that
+	//also reach the second are flooded separately, so two groups that each touch two edges don't count as a Y
+	bool connected(Side side) const {
+		const Bits * m = bit_masks_;
+		const Bits & stones = stones_[side.to_i() - 1];
+		Bits first = m[2].flood(size_, stones, m[0], m[1]);
+		return first.intersects(m[3]) && m[3].flood(size_, first, m[0], m[1]).intersects(m[4]);
+	}
+
+	//the outcome according to the bitboards, which works whether or not the groups are up to date
+	Outcome flood_outcome() const {
+		if(connected(Side::P1)) return Outcome::P1;
+		if(connected(Side::P2)) return Outcome::P2;
+		return Outcome::UNKNOWN;
+	}
+
+	//place a piece for a rollout that plays until the board is full. No groups are joined and no win is checked, so
+	//only the pieces, patterns and bitboards are kept up to date, not the groups or hash. Once the board is full,
+	//finish_fill finds the winner, which is the same as the first side to connect since a full
+	//board always has exactly one Y
+	void fill(const Move & pos) { fill(MoveValid(pos, xy(pos))); }
+	void fill(const MoveValid & pos) {
+		assert(!journal_ && valid_move(pos));
+
+		last_move_ = pos;
+		num_moves_++;
+
+		Cell & cell = cells_[pos.xy];
+		cell.piece = to_play_;
+		cell.perm = 0;
+
+		update_pattern(pos, to_play_);
+		stones_[to_play_.to_i() - 1].set(pos.xy);
+
+		to_play_ = ~to_play_;
+	}
+
+	Outcome finish_fill() {
+		assert(moves_avail() == 0);
+		outcome_ = flood_outcome();
+		return outcome_;
+	}
+
 	//test if making this move would win, but don't actually make the move
 	Outcome test_outcome(const Move & pos) const { return test_outcome(pos, to_play()); }
 	Outcome test_outcome(const Move & pos, Side turn) const { return test_outcome(MoveValid(pos, xy(pos)), turn); }
@@ -340,7 +428,14 @@ public:
 private:
 	int edges(int x, int y) const;
 
-	std::shared_ptr<MoveValid> gen_neighbor_list() const;
+	const MoveValid * gen_neighbor_list() const;
+	const Bits * gen_bit_masks() const;
+
+	//save a cell before changing it, so the move can be undone
+	void save(int i) const {
+		if(journal_)
+			journal_->save(i, cells_[i]);
+	}
 
 	int find_group(const MoveValid & m) const { return find_group(m.xy); }
 	int find_group(unsigned int i) const {
@@ -349,7 +444,10 @@ private:
 			do{
 				p = cells_[p].parent;
 			}while(p != cells_[p].parent);
-			cells_[i].parent = p; //do path compression, but only the current one, not all, to avoid recursion
+			//do path compression, but only the current one, not all, to avoid recursion. Skip it while keeping a journal,
+			//as saving every compression would cost more than it saves, and union by size keeps the groups shallow anyway
+			if(!journal_)
+				cells_[i].parent = p;
 		}
 		return p;
 	}
@@ -366,6 +464,8 @@ private:
 		if(cells_[i].size < cells_[j].size) //force i's subtree to be bigger
 			std::swap(i, j);
 
+		save(i);
+		save(j);
 		cells_[j].parent = i;
 		cells_[i].size   += cells_[j].size;
 		cells_[i].edge   |= cells_[j].edge;
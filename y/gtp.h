@@ -8,6 +8,7 @@
 
 #include "agent.h"
 //#include "agentab.h"
+#include "agentdfpn.h"
 #include "agentmcts.h"
 #include "agentpns.h"
 #include "board.h"
@@ -64,11 +65,12 @@ public:
 		newcallback("time",            std::bind(&GTP::gtp_time,          this, _1), "Set the time limits and the algorithm for per game time");
 		newcallback("genmove",         std::bind(&GTP::gtp_genmove,       this, _1), "Generate a move: genmove [color] [time]");
 		newcallback("g",               std::bind(&GTP::gtp_genmove,       this, _1), "Alias for genmove");
-		newcallback("solve",           std::bind(&GTP::gtp_solve,         this, _1), "Try to solve this position");
+		newcallback("solve",           std::bind(&GTP::gtp_solve,         this, _1), "Try to solve this position: solve [time] [--resume <checkpoint>]");
 
 //		newcallback("ab",              std::bind(&GTP::gtp_ab,            this, _1), "Switch to use the Alpha/Beta agent to play/solve");
 		newcallback("mcts",            std::bind(&GTP::gtp_mcts,          this, _1), "Switch to use the Monte Carlo Tree Search agent to play/solve");
 		newcallback("pns",             std::bind(&GTP::gtp_pns,           this, _1), "Switch to use the Proof Number Search agent to play/solve");
+		newcallback("dfpn",            std::bind(&GTP::gtp_dfpn,          this, _1), "Switch to use the memory bounded depth-first Proof Number Search agent to solve");
 
 		newcallback("all_legal",       std::bind(&GTP::gtp_all_legal,     this, _1), "List all legal moves");
 		newcallback("history",         std::bind(&GTP::gtp_history,       this, _1), "List of played moves");
@@ -79,11 +81,14 @@ public:
 
 		newcallback("pv",              std::bind(&GTP::gtp_pv,            this, _1), "Output the principle variation for the player tree as it stands now");
 		newcallback("move_stats",      std::bind(&GTP::gtp_move_stats,    this, _1), "Output the move stats for the player tree as it stands now");
+		newcallback("mem_stats",       std::bind(&GTP::gtp_mem_stats,     this, _1), "Output how the memory of the player tree is used, including fragmentation");
 
 		newcallback("params",          std::bind(&GTP::gtp_params,        this, _1), "Set the options for the player, no args gives options");
 
 		newcallback("save_sgf",        std::bind(&GTP::gtp_save_sgf,      this, _1), "Output an sgf of the current tree");
 		newcallback("load_sgf",        std::bind(&GTP::gtp_load_sgf,      this, _1), "Load an sgf generated by save_sgf");
+		newcallback("save_tree",       std::bind(&GTP::gtp_save_tree,     this, _1), "Save the current tree in a binary file that loads quickly");
+		newcallback("load_tree",       std::bind(&GTP::gtp_load_tree,     this, _1), "Load a tree saved by save_tree, along with its position");
 //		newcallback("player_gammas",   std::bind(&GTP::gtp_player_gammas, this, _1), "Load the gammas for weighted random from a file");
 		newcallback("toggle_tp",       std::bind(&GTP::toggle_to_play,    this, _1), "Toggle the current player");
                 newcallback("solveall",        std::bind(&GTP::solve_all,         this, _1), "Find all winning moves");
@@ -122,6 +127,7 @@ public:
 
 
 	GTPResponse gtp_move_stats(vecstr args);
+	GTPResponse gtp_mem_stats(vecstr args);
 	GTPResponse gtp_pv(vecstr args);
 	GTPResponse gtp_genmove(vecstr args);
 	GTPResponse gtp_solve(vecstr args);
@@ -134,10 +140,15 @@ public:
 	GTPResponse gtp_mcts_params(vecstr args);
 	GTPResponse gtp_pns(vecstr args);
 	GTPResponse gtp_pns_params(vecstr args);
+	GTPResponse gtp_dfpn(vecstr args);
+	GTPResponse gtp_dfpn_params(vecstr args);
 
 //	GTPResponse gtp_player_gammas(vecstr args);
 	GTPResponse gtp_save_sgf(vecstr args);
 	GTPResponse gtp_load_sgf(vecstr args);
+	GTPResponse gtp_save_tree(vecstr args);
+	GTPResponse gtp_load_tree(vecstr args);
+	std::string tree_info() const;
         GTPResponse toggle_to_play(vecstr args);
         GTPResponse solve_all(vecstr args);
 